@@ -24,7 +24,8 @@ AsyncColumnSqlTableModel::AsyncColumnSqlTableModel(
     const TCommonIndexesRanges& aCommonIndexRanges,
     bool aUseFileStorage,
     QObject* aParent,
-    const QPointer<TableOperationHandlerBase>& aHandler)
+    const QPointer<TableOperationHandlerBase>& aHandler,
+    bool aTrackRevisions)
     : AsyncSqlTableModelBase(
         aDataController->GetDatabaseConnections(),
         aTableName,
@@ -37,7 +38,8 @@ AsyncColumnSqlTableModel::AsyncColumnSqlTableModel(
         aSqlPrimaryKeyIndex,
         aUseFileStorage,
         aParent,
-        aHandler)
+        aHandler,
+        aTrackRevisions)
     , mFont(QApplication::font())
     , mCheckFont(QFont("nt-symbol"))
     , mFieldListSize(static_cast<int>(aFieldListSize))
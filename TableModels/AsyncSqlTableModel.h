@@ -27,6 +27,8 @@ public:
      * @param aCommonIndexRanges - диапазон колонок для полнотекстового поиска.
      * @param aUseFileStorage - БД может быть на диске или в памяти.
      * @param aHandler - объект плагина для кэша.
+     * @param aTrackRevisions - хранить колонку _rev, чтобы не перечитывать неизмененные строки окна
+     * после повторной выборки. По-умолчанию включено.
      */
     AsyncColumnSqlTableModel(
         IDataController* aDataController,
@@ -41,7 +43,8 @@ public:
         const TCommonIndexesRanges& aCommonIndexRanges,
         bool aUseFileStorage,
         QObject* aParent,
-        const QPointer<TableOperationHandlerBase>& aHandler = nullptr);
+        const QPointer<TableOperationHandlerBase>& aHandler = nullptr,
+        bool aTrackRevisions = true);
     virtual ~AsyncColumnSqlTableModel() override;
 
     virtual int columnCount(const QModelIndex& parent = QModelIndex()) const override;
@@ -258,7 +261,7 @@ public:
     template<typename TColumns>
     QVariant ExtractRowData(int aRecord, TColumns aCol) const
     {
-        auto rowPtr = mViewData.GetRow(aRecord);
+        auto rowPtr = GetRow(aRecord);
         if (rowPtr)
         {
             return THandler::ExtractRowData(*rowPtr, aCol);
@@ -273,7 +276,7 @@ public:
 
     TData GetRowData(int aRow) const
     {
-        auto rowPtr = mViewData.GetRow(aRow);
+        auto rowPtr = GetRow(aRow);
         if (rowPtr)
         {
             return GetRowData(*rowPtr);
@@ -397,12 +400,12 @@ protected:
         {
             if (const auto& item = AddPendingData(data))
             {
-                GetNewItemsBuffer().push_back(*item);
+                AddNewItem(*item);
             }
         }
         for (const auto id : aDeletedIds)
         {
-            GetNewItemsBuffer().push_back(QVariantList() << QVariant { static_cast<qlonglong>(id) });
+            AddNewItem(QVariantList() << QVariant { static_cast<qlonglong>(id) });
         }
 
         AsyncSqlTableModelBase::ProcessNewChunkCompleted();
@@ -1,14 +1,21 @@
 #include "AsyncSqlTableModelBase.h"
+#include "DbThreadPool.h"
 #include "Tracer.h"
 #include <Common/Finally.hpp>
 
 #include <cmath>
+#include <utility>
 
 class AsyncSqlTableEventProcessing : public QObject
 {
 public:
     static constexpr int MinUserTimerDurationMs = 0;
     static constexpr int CursorTimerDurationMs = 1000;
+    /// HeavyAction после прокрутки и выделения откладываются на время, пропорциональное
+    /// длительности последней выборки: дешевая выборка почти не задерживает обновление,
+    /// дорогая не занимает хранилище между шагами прокрутки.
+    static constexpr int EasyActionQuietPeriodFactor = 2;
+    static constexpr int MaxEasyActionQuietPeriodMs = 1000;
 
     AsyncSqlTableEventProcessing(
         AsyncSqlTableModelBase* aModel,
@@ -32,6 +39,8 @@ public:
 private:
     void OnTimerExpired();
     void StartTimer(bool aForce);
+    void PostponeTimer(int aMs);
+    int GetEasyActionQuietPeriodMs() const;
     void ProcessEventInternal(const AsyncSqlTableModelBase::Event aEvent);
     AsyncSqlTableModelBase::Command GetCommand() const;
 
@@ -71,6 +80,16 @@ struct State
     {
         TNewItemsBufferPtr WritingNewItemsBuffer = TNewItemsBufferPtr::create();
         std::optional<qint64> PendingUpdate;
+        /// PendingUpdate - HeavyAction, его выборку можно прервать
+        bool IsPendingHeavyUpdate = false;
+        /// EasyAction, отправленный во время HeavyAction.
+        /// Хранилище выполняет его между порциями чтения выборки.
+        std::optional<qint64> PendingEasyUpdate;
+        /// HeavyAction с новыми данными, отправленный до ответа на PendingUpdate.
+        /// Хранилище отвечает на запросы по порядку, поэтому после ответа
+        /// на PendingUpdate он становится PendingUpdate.
+        std::optional<qint64> PipelinedUpdate;
+        TNewItemsBufferPtr PipelinedNewItemsBuffer = TNewItemsBufferPtr::create();
         bool IsPendingClear = false;
         bool IsPendingUserQuery = false;
 
@@ -78,6 +97,25 @@ struct State
         {
             return WritingNewItemsBuffer->empty()
                 && !PendingUpdate
+                && !PendingEasyUpdate
+                && !IsPendingClear
+                && !IsPendingUserQuery;
+        }
+
+        bool IsUpdatePipeliningAllowed() const
+        {
+            return PendingUpdate
+                && IsPendingHeavyUpdate
+                && !PipelinedUpdate
+                && !IsPendingClear
+                && !IsPendingUserQuery;
+        }
+
+        bool IsEasyUpdateInterleavingAllowed() const
+        {
+            return PendingUpdate
+                && IsPendingHeavyUpdate
+                && !PendingEasyUpdate
                 && !IsPendingClear
                 && !IsPendingUserQuery;
         }
@@ -90,6 +128,11 @@ struct State
         LoadingStatus PendingLoadStatus = LoadingStatus::NotChanged;
         bool ResumeUpdates = false;
 
+        /// Позиции изменений в буфере для схлопывания по id.
+        std::unordered_map<qlonglong, size_t> PendingItemPositions;
+        /// Количество изменений, полученных до схлопывания.
+        size_t ReceivedItemsCount = 0;
+
         bool IsUpdateOperationNeeded() const
         {
             return !PendingNewItemsBuffer->empty()
@@ -166,6 +209,7 @@ AsyncSqlTableModelBase::Command AsyncSqlTableEventProcessing::GetCommand() const
             }
             else if (mState->mPendingUserEasyActionState.IsNeeded())
             {
+                /// EasyAction ограничены только выполняющимся запросом, но не таймером HeavyAction
                 return AsyncSqlTableModelBase::Command::SendUserActionRequest;
             }
             else if (mTimerState.IsOperationSendAllowed && mState->mPendingUserHeavyActionState.IsUpdateOperationNeeded())
@@ -178,6 +222,22 @@ AsyncSqlTableModelBase::Command AsyncSqlTableEventProcessing::GetCommand() const
             return AsyncSqlTableModelBase::Command::SendUpdateRequest;
         }
     }
+    else if (mState->mBackEndState.IsEasyUpdateInterleavingAllowed()
+        && mState->mFrontEndState.IsFrontendReady()
+        && mState->mPendingUserEasyActionState.IsNeeded())
+    {
+        /// Прокрутка не ждет завершения HeavyAction и обслуживается по предыдущей версии данных
+        return AsyncSqlTableModelBase::Command::SendUserActionRequest;
+    }
+    else if (mModel->mPipelineUpdates
+        && mState->mBackEndState.IsUpdatePipeliningAllowed()
+        && mTimerState.IsOperationSendAllowed
+        && mState->mPendingDataIncomingState.IsUpdateOperationNeeded()
+        && !mState->mPendingUserHeavyActionState.IsUpdateOperationNeeded())
+    {
+        /// Сортировка и фильтр прерывают выполняющуюся выборку, поэтому в конвейер попадают только новые данные
+        return AsyncSqlTableModelBase::Command::SendUpdateRequest;
+    }
 
     return AsyncSqlTableModelBase::Command::DoNothing;
 }
@@ -220,10 +280,12 @@ void AsyncSqlTableEventProcessing::ProcessEventInternal(const AsyncSqlTableModel
     case AsyncSqlTableModelBase::Event::SortOperation:
     case AsyncSqlTableModelBase::Event::FilterOperation:
     case AsyncSqlTableModelBase::Event::DeleteOperation:
+        StartTimer(true);
+        return;
     case AsyncSqlTableModelBase::Event::WindowOperation:
     case AsyncSqlTableModelBase::Event::SelectionOperation:
     case AsyncSqlTableModelBase::Event::SelectionAndWindowOperation:
-        StartTimer(true);
+        PostponeTimer(GetEasyActionQuietPeriodMs());
         return;
     case AsyncSqlTableModelBase::Event::FrontEndStateChanged:
     case AsyncSqlTableModelBase::Event::BackEndStateChanged:
@@ -311,6 +373,26 @@ void AsyncSqlTableEventProcessing::StartTimer(bool aForce)
     }
 }
 
+void AsyncSqlTableEventProcessing::PostponeTimer(int aMs)
+{
+    /// Во время прокрутки HeavyAction не занимают хранилище,
+    /// но и не ждут полную длительность последней выборки.
+    if (mTimerState.UserActionTimer.isActive()
+        && mTimerState.UserActionTimer.remainingTime() >= aMs)
+    {
+        return;
+    }
+    mTimerState.IsOperationSendAllowed = false;
+    mTimerState.UserActionTimer.start(aMs);
+}
+
+int AsyncSqlTableEventProcessing::GetEasyActionQuietPeriodMs() const
+{
+    return (std::min)(
+        mTimerState.LastUpdateDurationMs * EasyActionQuietPeriodFactor,
+        MaxEasyActionQuietPeriodMs);
+}
+
 AsyncSqlTableModelBase::AsyncSqlTableModelBase(
     const std::weak_ptr<DataBaseConnections>& aConnections,
     const QString& aTableName,
@@ -323,7 +405,8 @@ AsyncSqlTableModelBase::AsyncSqlTableModelBase(
     int aIdColumn,
     bool aUseFileStorage,
     QObject* aParent,
-    const QPointer<TableOperationHandlerBase>& aHandler)
+    const QPointer<TableOperationHandlerBase>& aHandler,
+    bool aTrackRevisions)
     : QAbstractTableModel(aParent)
     , mSyncTableModel(
         new SyncSqlCache(
@@ -338,14 +421,17 @@ AsyncSqlTableModelBase::AsyncSqlTableModelBase(
             aDefaultSortDirection,
             nullptr,
             aUseFileStorage,
-            aHandler))
+            aHandler,
+            aTrackRevisions))
     , mState(std::make_unique<State>(this))
     , mBackendHandler(aHandler)
     , mAsyncTableTracer(GetTracer(QString("model.%1.async").arg(GetTableName()).toStdString().c_str()))
     , mDefaultSortOrder(aDefaultSortOrder)
     , mDefaultSortDirection(aDefaultSortDirection)
+    , mIdColumn(aIdColumn)
 {
-    mSyncTableModel->moveToThread(&mDbThread);
+    mDbThread = DbThreadPool::Instance().Acquire();
+    mSyncTableModel->moveToThread(mDbThread);
 
     //
     // To cache from model
@@ -374,6 +460,18 @@ AsyncSqlTableModelBase::AsyncSqlTableModelBase(
     connect(
         this, &AsyncSqlTableModelBase::SetAutoScrollAsync,
         mSyncTableModel, &SyncSqlCache::On_SetAutoScroll);
+    connect(
+        this, &AsyncSqlTableModelBase::SetSortIndexesBudgetAsync,
+        mSyncTableModel, &SyncSqlCache::On_SetSortIndexesBudget);
+    connect(
+        this, &AsyncSqlTableModelBase::SetFullTextIndexAsync,
+        mSyncTableModel, &SyncSqlCache::On_SetFullTextIndex);
+    connect(
+        this, &AsyncSqlTableModelBase::SetOrderIndexAsync,
+        mSyncTableModel, &SyncSqlCache::On_SetOrderIndex);
+    connect(
+        this, &AsyncSqlTableModelBase::SetReaderConnectionAsync,
+        mSyncTableModel, &SyncSqlCache::On_SetReaderConnection);
 
     //
     // From cache to model
@@ -400,7 +498,6 @@ AsyncSqlTableModelBase::AsyncSqlTableModelBase(
         mSyncTableModel, &SyncSqlCache::ErrorOccured,
         this, &AsyncSqlTableModelBase::OnErrorOccured);
 
-    mDbThread.start();
     mCursorKeeperTimer.setSingleShot(true);
     mCursorKeeperTimer.setInterval(AsyncSqlTableEventProcessing::CursorTimerDurationMs);
     mCursorKeeperTimer.callOnTimeout(this, &AsyncSqlTableModelBase::OnCursorKeeperTimeout);
@@ -428,7 +525,7 @@ QVariant AsyncSqlTableModelBase::data(const QModelIndex &aIndex, int /*aRole*/)
         return QVariant();
     }
 
-    auto rowPtr = mViewData.GetRow(aIndex.row());
+    auto rowPtr = GetRow(aIndex.row());
     if (!rowPtr)
     {
         return QVariant();
@@ -462,6 +559,15 @@ void AsyncSqlTableModelBase::SetRowWindow(
         aTopRowHint,
         aBottomRowHint);
 
+    /// Если видимые строки уже есть в окне или в кэше строк, запрос окна не отправляется сразу:
+    /// он остается в mPendingUserEasyActionState и уйдет в хранилище со следующим событием
+    /// раньше HeavyAction, так что новое окно будет построено по актуальному диапазону.
+    const auto& requestedRows = mState->mPendingUserEasyActionState.RequestedRows;
+    if (requestedRows && IsRowRangeAvailable(requestedRows->RowWindowVisible))
+    {
+        return;
+    }
+
     ProcessEvent(AsyncSqlTableModelBase::Event::WindowOperation);
 }
 
@@ -478,11 +584,15 @@ void AsyncSqlTableModelBase::SetRowWindowInternal(
         newRange.Bottom = qMax(newRange.Top, aBottomRow);
     }
 
+    const auto [topMargin, bottomMargin] = CalculateRowWindowMargins(newRange);
+
     RowRequest rowRequest;
     {
         rowRequest.RowWindowVisible = newRange;
-        rowRequest.RowWindow = newRange.Expand(SqlQueryUtils::RowWindowOffset);
+        rowRequest.RowWindow = newRange.Expand(topMargin, bottomMargin);
         rowRequest.Version = mViewData.Version;
+        rowRequest.TopMargin = topMargin;
+        rowRequest.BottomMargin = bottomMargin;
     }
     mState->mPendingUserEasyActionState.RequestedRows = rowRequest;
 
@@ -495,6 +605,118 @@ void AsyncSqlTableModelBase::SetRowWindowInternal(
     mState->mPendingUserEasyActionState.RequestedHints = hintsRequest;
 }
 
+std::pair<int, int> AsyncSqlTableModelBase::CalculateRowWindowMargins(const RowRange& aVisibleRange)
+{
+    qint64 elapsedMs = -1;
+    if (mScrollTimer.isValid())
+    {
+        elapsedMs = mScrollTimer.restart();
+    }
+    else
+    {
+        mScrollTimer.start();
+    }
+
+    if (elapsedMs < 0 || elapsedMs > ScrollIdleMs || mLastVisibleTop < 0)
+    {
+        mScrollVelocity = 0.;
+    }
+    else if (elapsedMs > 0)
+    {
+        const double velocity = (aVisibleRange.Top - mLastVisibleTop) * 1000. / elapsedMs;
+        mScrollVelocity = (mScrollVelocity + velocity) / 2.;
+    }
+    mLastVisibleTop = aVisibleRange.Top;
+
+    // пока окно загружается, прокрутка уходит вперед на |v| * t строк
+    const auto windowRows = aVisibleRange.Count() + 2 * SqlQueryUtils::RowWindowOffset;
+    const double loadTimeSec = (WindowRequestLatencyUs + mViewData.RowFetchCostUs * windowRows) / 1e6;
+    const auto lead = static_cast<int>(std::abs(mScrollVelocity) * loadTimeSec);
+    if (lead == 0)
+    {
+        return { SqlQueryUtils::RowWindowOffset, SqlQueryUtils::RowWindowOffset };
+    }
+
+    const auto rowSize = qMax(1, columnCount()) * EstimatedCellSize;
+    const auto maxMargins = qMax(
+        2 * SqlQueryUtils::RowWindowOffset,
+        RowWindowMemoryBudget / rowSize - aVisibleRange.Count());
+
+    const auto behind = SqlQueryUtils::RowWindowOffset / 2;
+    const auto ahead = qMin(SqlQueryUtils::RowWindowOffset + lead, maxMargins - behind);
+
+    return mScrollVelocity < 0
+        ? std::pair<int, int> { ahead, behind }
+        : std::pair<int, int> { behind, ahead };
+}
+
+const QVariantList* AsyncSqlTableModelBase::GetRow(int aRow) const
+{
+    if (const auto* row = mViewData.GetRow(aRow))
+    {
+        return row;
+    }
+
+    if (mRowCacheVersion != mViewData.Version || aRow >= mViewData.RecordsCount)
+    {
+        return nullptr;
+    }
+
+    auto it = mRowCache.find(aRow);
+    return it != mRowCache.cend() ? &it->second : nullptr;
+}
+
+bool AsyncSqlTableModelBase::IsRowRangeAvailable(const RowRange& aRange) const
+{
+    if (!aRange.IsValid())
+    {
+        return false;
+    }
+    const auto bottom = (std::min)(aRange.Bottom, mViewData.RecordsCount - 1);
+    for (int r = aRange.Top; r <= bottom; ++r)
+    {
+        if (!GetRow(r))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AsyncSqlTableModelBase::UpdateRowCache()
+{
+    if (mRowCacheVersion != mViewData.Version || mRowCacheRowsRevision != mViewData.RowsRevision)
+    {
+        mRowCache.clear();
+        mRowCacheVersion = mViewData.Version;
+        mRowCacheRowsRevision = mViewData.RowsRevision;
+    }
+
+    for (int r = mViewData.Rows.Top; mViewData.Rows.IsValid() && r <= mViewData.Rows.Bottom; ++r)
+    {
+        if (const auto* row = std::as_const(mViewData).GetRow(r))
+        {
+            mRowCache.insert_or_assign(r, *row);
+        }
+    }
+
+    // вытесняются строки, наиболее удаленные от видимого диапазона
+    const auto& visible = mViewData.RowsVisible;
+    while (mRowCache.size() > RowCacheSize)
+    {
+        const auto first = mRowCache.begin();
+        const auto last = std::prev(mRowCache.end());
+        if (visible.Distance(first->first) >= visible.Distance(last->first))
+        {
+            mRowCache.erase(first);
+        }
+        else
+        {
+            mRowCache.erase(last);
+        }
+    }
+}
+
 const ViewWindowValues& AsyncSqlTableModelBase::GetViewData() const
 {
     return mViewData;
@@ -542,9 +764,9 @@ bool AsyncSqlTableModelBase::IsBusy() const
 
 bool AsyncSqlTableModelBase::IsThreadCompletelyStopped() const
 {
-    /// Поток считается полностью завершённым, если он остановился 
+    /// Поток считается полностью завершённым, если модель отказалась от него
     /// и объекты, которые обрабатывались в его EventLoop, удалены.
-    return !mSyncTableModel && !mBackendHandler && mDbThread.isFinished();
+    return !mSyncTableModel && !mBackendHandler && !mDbThread;
 }
 
 std::optional<std::pair<int, Qt::SortOrder>> AsyncSqlTableModelBase::GetDefaultSortIndicator() const
@@ -677,7 +899,7 @@ bool AsyncSqlTableModelBase::IsDataLoaded(const QModelIndex &aIndex) const
         return false;
     }
 
-    return mViewData.GetRow(aIndex.row());
+    return GetRow(aIndex.row());
 }
 
 bool AsyncSqlTableModelBase::StartExport(const QString &aExportFileName, const ColumnsExportInfo &aColumns)
@@ -704,24 +926,29 @@ bool AsyncSqlTableModelBase::AbortExport()
 
 void AsyncSqlTableModelBase::StopThread()
 {
-    if (mDbThread.isRunning())
+    if (!mDbThread)
+    {
+        return;
+    }
+
+    if (mSyncTableModel)
     {
-        mSyncTableModel->setParent(nullptr);
-        mSyncTableModel->deleteLater();
         disconnect(mSyncTableModel, nullptr, nullptr, nullptr);
         this->disconnect(mSyncTableModel);
 
-        mDbThread.quit();
-        int i = 0;
-        while (!mDbThread.wait(500) || !IsThreadCompletelyStopped())
-        {
-            if (++i == 100)
-            {
-                mDbThread.terminate();
-            }
-            mAsyncTableTracer.Info("Wait for thread");
-        }
+        /// Кэш удаляется в своем потоке после уже поставленных в очередь событий,
+        /// front-поток удаления не ждет. Поток возвращается в пул после удаления кэша.
+        QObject::connect(
+            mSyncTableModel, &QObject::destroyed,
+            [thread = mDbThread]() { DbThreadPool::Instance().Release(thread); });
+        mSyncTableModel->deleteLater();
     }
+    else
+    {
+        DbThreadPool::Instance().Release(mDbThread);
+    }
+
+    mDbThread = nullptr;
 }
 
 void AsyncSqlTableModelBase::SetLoadingFinished(bool aFinished)
@@ -754,6 +981,7 @@ void AsyncSqlTableModelBase::Clear(bool aIsFinal)
         mState = std::make_unique<State>(this);
         mState->mBackEndState.IsPendingClear = true;
         mViewData = ViewWindowValues{};
+        mRowCache.clear();
         mDbRecordsCount = 0;
         mError.clear();
         mPendingViewWindowUpdate = false;
@@ -801,18 +1029,49 @@ void AsyncSqlTableModelBase::SetSuspendUpdates(bool aSuspend)
     ProcessEvent(AsyncSqlTableModelBase::Event::UpdateSuspensionFlagChanged);
 }
 
+void AsyncSqlTableModelBase::SetUpdatesCoalescing(bool aIsEnabled)
+{
+    mCoalesceUpdates = aIsEnabled;
+    if (!mCoalesceUpdates)
+    {
+        mState->mPendingDataIncomingState.PendingItemPositions.clear();
+    }
+}
+
+void AsyncSqlTableModelBase::SetUpdatesPipelining(bool aIsEnabled)
+{
+    mPipelineUpdates = aIsEnabled;
+}
+
 void AsyncSqlTableModelBase::PrepareSortOperation(int aColumn, int aOrder)
 {
     mState->mPendingUserHeavyActionState.mPendingSorting = SortParameters { aColumn, aOrder };
+    InterruptPendingSelection();
     ProcessEvent(AsyncSqlTableModelBase::Event::SortOperation);
 }
 
 void AsyncSqlTableModelBase::PrepareFilterOperation(const QString& aFilter)
 {
      mState->mPendingUserHeavyActionState.mPendingFilter = aFilter;
+     InterruptPendingSelection();
      ProcessEvent(AsyncSqlTableModelBase::Event::FilterOperation);
 }
 
+void AsyncSqlTableModelBase::InterruptPendingSelection()
+{
+    const auto& backEndState = mState->mBackEndState;
+    if (!backEndState.PendingUpdate || !backEndState.IsPendingHeavyUpdate || !mSyncTableModel)
+    {
+        return;
+    }
+
+    /// Выборка выполняющегося запроса все равно будет заменена выборкой с новой сортировкой или фильтром.
+    /// Прерываются и запросы в конвейере.
+    const auto requestId = backEndState.PipelinedUpdate.value_or(*backEndState.PendingUpdate);
+    mAsyncTableTracer.Info(QString("%1: OpId: %2").arg(Q_FUNC_INFO).arg(requestId));
+    mSyncTableModel->InterruptSelection(requestId);
+}
+
 void AsyncSqlTableModelBase::ProcessNewChunkCompleted()
 {
     UpdateBufferLogSize();
@@ -863,8 +1122,23 @@ void AsyncSqlTableModelBase::OnViewWindowValuesChanged(
             .arg(aIsUpdated)
             .arg(turnaroundMs));
 
-    mState->mBackEndState.PendingUpdate.reset();
-    mState->mBackEndState.WritingNewItemsBuffer->clear();
+    if (mState->mBackEndState.PendingEasyUpdate == aValues.RequestId)
+    {
+        mState->mBackEndState.PendingEasyUpdate.reset();
+    }
+    else
+    {
+        auto& backEndState = mState->mBackEndState;
+        backEndState.PendingUpdate.reset();
+        backEndState.WritingNewItemsBuffer->clear();
+        if (backEndState.PipelinedUpdate)
+        {
+            backEndState.PendingUpdate = backEndState.PipelinedUpdate;
+            backEndState.IsPendingHeavyUpdate = true;
+            backEndState.WritingNewItemsBuffer.swap(backEndState.PipelinedNewItemsBuffer);
+            backEndState.PipelinedUpdate.reset();
+        }
+    }
 
     if (aSelectionDuration.isValid())
     {
@@ -898,6 +1172,10 @@ void AsyncSqlTableModelBase::OnViewWindowValuesChanged(
     }
 
     mPendingViewWindowUpdate = false;
+    if (mRowCacheVersion != aValues.Version || mRowCacheRowsRevision != aValues.RowsRevision)
+    {
+        mRowCache.clear();
+    }
     mBlockedUserActions.insert(Event::SelectionOperation);
     if (mViewData.RecordsCount == aValues.RecordsCount)
     {
@@ -954,6 +1232,14 @@ void AsyncSqlTableModelBase::OnViewWindowValuesChanged(
     if (mViewData.ExtraData != aValues.ExtraData)
     {
         mViewData.ExtraData = aValues.ExtraData;
+
+        /// Отображение строк может зависеть от ExtraData, даже если значения строк не изменились
+        const auto& visibleRows = mViewData.RowsVisible;
+        const auto bottom = (std::min)(visibleRows.Bottom, mViewData.RecordsCount - 1);
+        if (visibleRows.IsValid() && visibleRows.Top <= bottom)
+        {
+            emit dataChanged(index(visibleRows.Top, 0), index(bottom, columnCount() - 1));
+        }
     }
 
     if (mViewData.Version != aValues.Version)
@@ -962,8 +1248,11 @@ void AsyncSqlTableModelBase::OnViewWindowValuesChanged(
         emit ConfirmVersionAsync(aValues.Version);
     }
 
+    mViewData.RowsRevision = aValues.RowsRevision;
     mViewData.RequestId = aValues.RequestId;
 
+    UpdateRowCache();
+
     emit ViewWindowValuesChanged();
 
     mBlockedUserActions.clear();
@@ -1008,6 +1297,7 @@ void AsyncSqlTableModelBase::OnErrorOccured(const QString& aErrorMessage)
         ProcessEvent(AsyncSqlTableModelBase::Event::ErrorOccured);
         
         mViewData = ViewWindowValues{};
+        mRowCache.clear();
         mDbRecordsCount = 0;
         TryRestoreCursor();
         emit DbRecordsCountChanged();
@@ -1084,7 +1374,15 @@ AsyncSqlTableModelBase::Command AsyncSqlTableModelBase::ProcessEvent(
     {
     case AsyncSqlTableModelBase::Command::SendUserActionRequest:
     {
-        mState->mBackEndState.PendingUpdate = ++mOperationId;
+        if (mState->mBackEndState.PendingUpdate)
+        {
+            mState->mBackEndState.PendingEasyUpdate = ++mOperationId;
+        }
+        else
+        {
+            mState->mBackEndState.PendingUpdate = ++mOperationId;
+            mState->mBackEndState.IsPendingHeavyUpdate = false;
+        }
 
         const auto rowRequest = GetRowRequest();
         const auto selectionRequest = GetSelectionRequest();
@@ -1108,14 +1406,28 @@ AsyncSqlTableModelBase::Command AsyncSqlTableModelBase::ProcessEvent(
     }
     case AsyncSqlTableModelBase::Command::SendUpdateRequest:
     {
-        mState->mBackEndState.WritingNewItemsBuffer.swap(
-            mState->mPendingDataIncomingState.PendingNewItemsBuffer);
+        const auto receivedItemsCount = mState->mPendingDataIncomingState.ReceivedItemsCount;
+        auto& backEndState = mState->mBackEndState;
+        /// Если предыдущий HeavyAction еще выполняется, запрос ставится в конвейер
+        const bool isPipelined = backEndState.PendingUpdate.has_value();
+        auto& writingBuffer = isPipelined
+            ? backEndState.PipelinedNewItemsBuffer
+            : backEndState.WritingNewItemsBuffer;
+        writingBuffer.swap(mState->mPendingDataIncomingState.PendingNewItemsBuffer);
 
-        mState->mBackEndState.PendingUpdate = ++mOperationId;
+        if (isPipelined)
+        {
+            backEndState.PipelinedUpdate = ++mOperationId;
+        }
+        else
+        {
+            backEndState.PendingUpdate = ++mOperationId;
+            backEndState.IsPendingHeavyUpdate = true;
+        }
 
         emit ProcessHeavyActionAsync(
             mOperationId,
-            mState->mBackEndState.WritingNewItemsBuffer,
+            writingBuffer,
             mState->mPendingDataIncomingState.PendingLoadStatus,
             mState->mPendingUserHeavyActionState.mPendingSorting,
             mState->mPendingUserHeavyActionState.mPendingFilter,
@@ -1129,9 +1441,13 @@ AsyncSqlTableModelBase::Command AsyncSqlTableModelBase::ProcessEvent(
 
         if (!aIsSupressLogging)
         {
-            mAsyncTableTracer.Trace(QString("%1, size: %2")
+            const auto size = writingBuffer->size();
+            mAsyncTableTracer.Trace(QString("%1, size: %2, received: %3, coalescing ratio: %4, pipelined: %5")
                 .arg(traceMsgCommon)
-                .arg(mState->mBackEndState.WritingNewItemsBuffer->size()));
+                .arg(size)
+                .arg(receivedItemsCount)
+                .arg(size ? static_cast<double>(receivedItemsCount) / size : 1.0, 0, 'f', 2)
+                .arg(isPipelined));
         }
 
         break;
@@ -1213,3 +1529,29 @@ TNewItemsBuffer& AsyncSqlTableModelBase::GetNewItemsBuffer()
 {
     return *mState->mPendingDataIncomingState.PendingNewItemsBuffer;
 }
+
+void AsyncSqlTableModelBase::AddNewItem(const QVariantList& aItem)
+{
+    auto& incomingState = mState->mPendingDataIncomingState;
+    auto& buffer = *incomingState.PendingNewItemsBuffer;
+    ++incomingState.ReceivedItemsCount;
+
+    if (!mCoalesceUpdates)
+    {
+        buffer.push_back(aItem);
+        return;
+    }
+
+    /// Удаление приходит строкой из одного id,
+    /// в остальных строках id находится в колонке первичного ключа.
+    const auto id = (aItem.size() > 1 ? aItem.value(mIdColumn) : aItem.value(0)).toLongLong();
+    const auto [it, inserted] = incomingState.PendingItemPositions.try_emplace(id, buffer.size());
+    if (inserted)
+    {
+        buffer.push_back(aItem);
+    }
+    else
+    {
+        buffer[it->second] = aItem;
+    }
+}
@@ -4,8 +4,10 @@
 #include "UiHelpers.h"
 
 #include <QAbstractTableModel>
+#include <QElapsedTimer>
 #include <QThread>
 
+#include <map>
 #include <memory>
 
 class AsyncSqlTableModelBase;
@@ -71,7 +73,8 @@ private:
     Q_OBJECT
 
     QPointer<SyncSqlCache> mSyncTableModel;
-    QThread mDbThread;
+    /// Поток из DbThreadPool: собственный или, если включены общие потоки, общий с другими моделями
+    QThread* mDbThread = nullptr;
     
     static constexpr size_t mSkipLoggingSize = 1000;
 
@@ -88,6 +91,20 @@ protected:
     /// Данные
     ViewWindowValues mViewData;
 
+    /// Строки прежних окон той же версии данных, по номеру строки.
+    /// Показываются при прокрутке, пока хранилище не прислало новое окно.
+    /// Очищается при смене mViewData.Version, так как номера строк меняются,
+    /// и при смене mViewData.RowsRevision, так как значения строк вне окна устаревают.
+    static constexpr size_t RowCacheSize = 10000;
+    std::map<int, QVariantList> mRowCache;
+    qint64 mRowCacheVersion = -1;
+    qint64 mRowCacheRowsRevision = 0;
+
+    /// Строка окна или строка из mRowCache текущей версии
+    const QVariantList* GetRow(int aRow) const;
+    /// Все строки диапазона (в пределах RecordsCount) есть в окне или в mRowCache
+    bool IsRowRangeAvailable(const RowRange& aRange) const;
+
     /// Экспорт
     bool mIsPendingExport = false;
 
@@ -103,6 +120,8 @@ protected:
 
     SqlQueryUtils::TSortOrder mDefaultSortOrder;
     Qt::SortOrder mDefaultSortDirection;
+    /// Колонка первичного ключа в строках, отправляемых в хранилище.
+    const int mIdColumn;
 
     /// Переменная отражает желаемое поведение асинхронного хранилища
     /// и соответствует состоянию переключателя в интерфейсе.
@@ -110,7 +129,29 @@ protected:
     /// При изменении этого флага также отправляется HeavyAction запрос.
     bool mSuspendUpdates = false;
 
+    /// Если флаг выставлен, в буфере новых данных хранится только
+    /// последнее изменение (строка или удаление) для каждого id.
+    bool mCoalesceUpdates = false;
+
+    /// Если флаг выставлен, следующий HeavyAction с новыми данными отправляется,
+    /// не дожидаясь ответа на выполняющийся.
+    bool mPipelineUpdates = false;
+
+    /// Упреждающая загрузка окна.
+    /// Запас окна в направлении прокрутки растет со скоростью прокрутки
+    /// и временем загрузки строки, но ограничен объемом памяти под окно.
+    static constexpr qint64 ScrollIdleMs = 300;                      ///< пауза, после которой прокрутка считается остановленной
+    static constexpr qint64 WindowRequestLatencyUs = 50000;          ///< задержка доставки запроса окна и ответа хранилища
+    static constexpr int RowWindowMemoryBudget = 16 * 1024 * 1024;   ///< байт под строки окна
+    static constexpr int EstimatedCellSize = 64;                     ///< оценка размера ячейки, байт
+    QElapsedTimer mScrollTimer;
+    int mLastVisibleTop = -1;
+    /// Сглаженная скорость прокрутки, строк в секунду. Знак - направление.
+    double mScrollVelocity = 0.;
+
 public:
+    /// aTrackRevisions - хранить в основной таблице колонку _rev. Тогда после повторной выборки
+    /// строки окна с прежним _rev не перечитываются, но каждая вставка пишет на одну колонку больше.
     AsyncSqlTableModelBase(
         const std::weak_ptr<DataBaseConnections>& aConnections,
         const QString& aTableName,
@@ -123,7 +164,8 @@ public:
         int aIdColumn,
         bool aUseFileStorage,
         QObject* aParent,
-        const QPointer<TableOperationHandlerBase>& aHandler = nullptr);
+        const QPointer<TableOperationHandlerBase>& aHandler = nullptr,
+        bool aTrackRevisions = true);
     ~AsyncSqlTableModelBase() override;
 
     int rowCount(const QModelIndex &aParent = QModelIndex()) const override;
@@ -177,6 +219,14 @@ public:
     void ReportSelected();
 
     void SetSuspendUpdates(bool aSuspend);
+    /// Включение схлопывания изменений одного id в буфере новых данных.
+    void SetUpdatesCoalescing(bool aIsEnabled);
+    /// Включение конвейера HeavyAction: пока хранилище выбирает данные по предыдущему запросу,
+    /// в его очереди уже находится следующий буфер. В полете не больше двух HeavyAction.
+    /// Хранилище выполняет следующий запрос после чтения выборки предыдущего, прокрутка
+    /// обрабатывается между порциями выборки. Выигрыш конвейера - в отправке и передаче буфера,
+    /// вставка следующего буфера с чтением выборки не совмещается.
+    void SetUpdatesPipelining(bool aIsEnabled);
 
 protected:
     void Clear(bool aIsFinal = false);
@@ -189,6 +239,8 @@ protected:
     QString GetTableName() const;
     void UpdateBufferLogSize();
     TNewItemsBuffer& GetNewItemsBuffer();
+    /// Добавление строки или удаления (строка из одного id) в буфер новых данных.
+    void AddNewItem(const QVariantList& aItem);
 
 signals:
     /// Model --> SyncCache
@@ -198,6 +250,16 @@ signals:
 
     void StartExportAsync(const QString &aExportFileName, const ColumnsExportInfo &aColumns);
     void SetAutoScrollAsync(bool aIsAutoScroll);
+    /// Бюджет индексов, которые хранилище строит для используемых сортировок.
+    void SetSortIndexesBudgetAsync(int aMaxIndexesCount);
+    /// Включение полнотекстового индекса FTS5 для быстрого общего поиска.
+    void SetFullTextIndexAsync(bool aIsEnabled);
+    /// Включение индекса позиций строк в памяти: изменения в любом месте выборки
+    /// применяются без повторного SELECT ценой хранения ключей сортировки.
+    void SetOrderIndexAsync(bool aIsEnabled);
+    /// Отдельное соединение для чтения в режиме WAL (только для файлового хранилища):
+    /// пользовательские запросы и экспорт не ждут записи новых данных.
+    void SetReaderConnectionAsync(bool aIsEnabled);
 
     void ClearTableAsync(bool aIsFinal);
     void PerformUserQueryAsync(QString aSql, QVariantList aParams);
@@ -245,6 +307,7 @@ private slots:
     void OnErrorOccured(const QString& aErrorMessage);
 
 private:
+    void UpdateRowCache();
     void TryEngageCursor();
     void TryRestoreCursor();
     std::pair<QVector<RowRange>, int> CorrectSelection(const QVector<RowRange>& aSelection, int aCurrentRow) const;
@@ -262,9 +325,14 @@ private:
         const EdgeRowHintType aTopRowHint = EdgeRowHintType::Full,
         const EdgeRowHintType aBottomRowHint = EdgeRowHintType::Full);
 
+    /// Запас окна сверху и снизу от aVisibleRange с учетом прокрутки
+    std::pair<int, int> CalculateRowWindowMargins(const RowRange& aVisibleRange);
+
     RowRequest GetRowRequest() const;
     SelectionRequest GetSelectionRequest() const;
     HintsRequest GetHintsRequest() const;
+    /// Прерывает выборку выполняющегося HeavyAction, которую заменит новая сортировка или фильтр.
+    void InterruptPendingSelection();
 
     Command ProcessEvent(
         const Event aEvent,
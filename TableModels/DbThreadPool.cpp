@@ -0,0 +1,118 @@
+#include "DbThreadPool.h"
+
+#include <algorithm>
+#include <iterator>
+
+DbThreadPool& DbThreadPool::Instance()
+{
+    static DbThreadPool pool;
+    return pool;
+}
+
+DbThreadPool::~DbThreadPool()
+{
+    for (auto& worker : mWorkers)
+    {
+        worker.Thread->quit();
+        worker.Thread->wait();
+    }
+}
+
+QThread* DbThreadPool::Acquire()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto worker = mWorkers.end();
+    if (mIsShared)
+    {
+        const auto sharedCount = std::count_if(
+            mWorkers.cbegin(),
+            mWorkers.cend(),
+            [](const Worker& aWorker) { return aWorker.IsShared; });
+        for (auto it = mWorkers.begin(); it != mWorkers.end(); ++it)
+        {
+            if (it->IsShared && (worker == mWorkers.end() || it->Load < worker->Load))
+            {
+                worker = it;
+            }
+        }
+        if (worker != mWorkers.end() && worker->Load > 0 && sharedCount < GetMaxThreadCountUnsafe())
+        {
+            worker = mWorkers.end();
+        }
+    }
+
+    if (worker == mWorkers.end())
+    {
+        Worker newWorker { std::make_unique<QThread>(), 0, mIsShared };
+        newWorker.Thread->setObjectName(QString("DbThread%1").arg(mWorkers.size()));
+        newWorker.Thread->start();
+        mWorkers.push_back(std::move(newWorker));
+        worker = std::prev(mWorkers.end());
+    }
+
+    ++worker->Load;
+    return worker->Thread.get();
+}
+
+void DbThreadPool::Release(QThread* aThread)
+{
+    QThread* stoppedThread = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        auto worker = std::find_if(
+            mWorkers.begin(),
+            mWorkers.end(),
+            [aThread](const Worker& aWorker) { return aWorker.Thread.get() == aThread; });
+        if (worker == mWorkers.end())
+        {
+            return;
+        }
+
+        if (--worker->Load == 0)
+        {
+            stoppedThread = worker->Thread.release();
+            mWorkers.erase(worker);
+        }
+    }
+
+    /// Release может быть вызван из самого потока, поэтому остановка не ожидается:
+    /// объект потока удаляется в создавшем его потоке после завершения цикла событий.
+    if (stoppedThread)
+    {
+        QObject::connect(stoppedThread, &QThread::finished, stoppedThread, &QObject::deleteLater);
+        stoppedThread->quit();
+    }
+}
+
+void DbThreadPool::SetShared(bool aIsShared)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mIsShared = aIsShared;
+}
+
+bool DbThreadPool::IsShared() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mIsShared;
+}
+
+void DbThreadPool::SetMaxThreadCount(int aMaxThreadCount)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMaxThreadCount = (std::max)(aMaxThreadCount, 0);
+}
+
+int DbThreadPool::GetMaxThreadCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return GetMaxThreadCountUnsafe();
+}
+
+int DbThreadPool::GetMaxThreadCountUnsafe() const
+{
+    return mMaxThreadCount > 0
+        ? mMaxThreadCount
+        : (std::max)(QThread::idealThreadCount(), 1);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QThread>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// @class DbThreadPool
+/// @brief Потоки хранилищ моделей.
+/// По умолчанию каждая модель получает собственный поток. После SetShared(true) потоки
+/// общие: их количество ограничено количеством ядер, модель получает наименее загруженный поток.
+/// Модели в общем потоке выполняют события по очереди и задерживают друг друга,
+/// поэтому общие потоки включаются для рабочих мест с большим количеством малоактивных таблиц.
+/// Модель остается в своем потоке до удаления, поэтому ее события выполняются последовательно.
+/// Соединение SQLite привязано к потоку, в котором открыто, поэтому модели между потоками не переносятся.
+class DbThreadPool
+{
+public:
+    static DbThreadPool& Instance();
+
+    ~DbThreadPool();
+
+    /// Возвращает собственный поток модели или, если включены общие потоки,
+    /// общий поток с наименьшим количеством моделей.
+    /// Новый общий поток создается, пока их меньше GetMaxThreadCount().
+    QThread* Acquire();
+    /// Вызывается после удаления объектов модели из потока, в том числе из самого потока.
+    /// Поток без моделей останавливается без ожидания и удаляется после остановки.
+    void Release(QThread* aThread);
+
+    /// Действует на потоки, выдаваемые после вызова.
+    void SetShared(bool aIsShared);
+    bool IsShared() const;
+    /// 0 - по количеству ядер. Действует на потоки, выдаваемые после вызова.
+    void SetMaxThreadCount(int aMaxThreadCount);
+    int GetMaxThreadCount() const;
+
+private:
+    struct Worker
+    {
+        std::unique_ptr<QThread> Thread;
+        /// Количество моделей, работающих в потоке
+        int Load = 0;
+        bool IsShared = false;
+    };
+
+    DbThreadPool() = default;
+
+    mutable std::mutex mMutex;
+    std::vector<Worker> mWorkers;
+    bool mIsShared = false;
+    int mMaxThreadCount = 0;
+
+    int GetMaxThreadCountUnsafe() const;
+};
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+/// @class OrderStatisticTree
+/// @brief Декартово дерево (treap) с размерами поддеревьев.
+/// Вставка, удаление, поиск позиции значения и значения по позиции выполняются за O(log n).
+/// Значения уникальны в смысле TLess.
+/// Узлы хранятся в одном векторе, освободившиеся узлы переиспользуются.
+template<typename TValue, typename TLess>
+class OrderStatisticTree
+{
+public:
+    explicit OrderStatisticTree(TLess aLess)
+        : mLess(std::move(aLess))
+    {}
+
+    size_t Size() const
+    {
+        return GetSize(mRoot);
+    }
+
+    void Clear()
+    {
+        mNodes.clear();
+        mFreeNodes.clear();
+        mRoot = Null;
+    }
+
+    /// Строит дерево из значений, упорядоченных по TLess, за O(n).
+    void Assign(std::vector<TValue>&& aSortedValues)
+    {
+        Clear();
+        mNodes.reserve(aSortedValues.size());
+
+        /// Правая ветвь дерева, построенного из уже обработанных значений
+        std::vector<uint32_t> rightSpine;
+        for (auto& value : aSortedValues)
+        {
+            const auto node = CreateNode(std::move(value));
+            auto last = Null;
+            while (!rightSpine.empty() && mNodes[rightSpine.back()].Priority < mNodes[node].Priority)
+            {
+                last = rightSpine.back();
+                rightSpine.pop_back();
+            }
+            mNodes[node].Left = last;
+            if (!rightSpine.empty())
+            {
+                mNodes[rightSpine.back()].Right = node;
+            }
+            rightSpine.push_back(node);
+        }
+        mRoot = rightSpine.empty() ? Null : rightSpine.front();
+        aSortedValues.clear();
+
+        UpdateSizes(mRoot);
+    }
+
+    /// Позиция значения в порядке TLess
+    std::optional<size_t> Rank(const TValue& aValue) const
+    {
+        size_t rank = 0;
+        auto node = mRoot;
+        while (node != Null)
+        {
+            const auto& current = mNodes[node];
+            if (mLess(aValue, current.Value))
+            {
+                node = current.Left;
+            }
+            else if (mLess(current.Value, aValue))
+            {
+                rank += GetSize(current.Left) + 1;
+                node = current.Right;
+            }
+            else
+            {
+                return rank + GetSize(current.Left);
+            }
+        }
+        return std::nullopt;
+    }
+
+    /// Значение по позиции. aRank должен быть меньше Size().
+    const TValue& At(size_t aRank) const
+    {
+        auto node = mRoot;
+        for (;;)
+        {
+            const auto& current = mNodes[node];
+            const auto leftSize = GetSize(current.Left);
+            if (aRank < leftSize)
+            {
+                node = current.Left;
+            }
+            else if (aRank > leftSize)
+            {
+                aRank -= leftSize + 1;
+                node = current.Right;
+            }
+            else
+            {
+                return current.Value;
+            }
+        }
+    }
+
+    /// Возвращает false, если равное значение уже есть в дереве.
+    bool Insert(TValue aValue)
+    {
+        if (Rank(aValue))
+        {
+            return false;
+        }
+
+        auto [left, right] = Split(mRoot, aValue);
+        const auto node = CreateNode(std::move(aValue));
+        mRoot = Merge(Merge(left, node), right);
+        return true;
+    }
+
+    /// Возвращает false, если значения нет в дереве.
+    bool Erase(const TValue& aValue)
+    {
+        bool isErased = false;
+        mRoot = Erase(mRoot, aValue, isErased);
+        return isErased;
+    }
+
+    /// Обход значений в порядке TLess
+    template<typename TFunc>
+    void ForEach(TFunc&& aFunc) const
+    {
+        std::vector<uint32_t> stack;
+        auto node = mRoot;
+        while (node != Null || !stack.empty())
+        {
+            while (node != Null)
+            {
+                stack.push_back(node);
+                node = mNodes[node].Left;
+            }
+            node = stack.back();
+            stack.pop_back();
+            aFunc(mNodes[node].Value);
+            node = mNodes[node].Right;
+        }
+    }
+
+private:
+    static constexpr uint32_t Null = UINT32_MAX;
+
+    struct Node
+    {
+        TValue Value;
+        uint32_t Priority;
+        uint32_t Left = Null;
+        uint32_t Right = Null;
+        uint32_t Size = 1;
+    };
+
+    TLess mLess;
+    std::vector<Node> mNodes;
+    std::vector<uint32_t> mFreeNodes;
+    uint32_t mRoot = Null;
+    std::mt19937 mRandom;
+
+    uint32_t GetSize(uint32_t aNode) const
+    {
+        return aNode == Null ? 0 : mNodes[aNode].Size;
+    }
+
+    void UpdateSize(uint32_t aNode)
+    {
+        auto& node = mNodes[aNode];
+        node.Size = GetSize(node.Left) + GetSize(node.Right) + 1;
+    }
+
+    /// Глубина дерева - O(log n), рекурсия допустима
+    void UpdateSizes(uint32_t aNode)
+    {
+        if (aNode == Null)
+        {
+            return;
+        }
+        UpdateSizes(mNodes[aNode].Left);
+        UpdateSizes(mNodes[aNode].Right);
+        UpdateSize(aNode);
+    }
+
+    uint32_t CreateNode(TValue&& aValue)
+    {
+        Node node { std::move(aValue), static_cast<uint32_t>(mRandom()) };
+        if (!mFreeNodes.empty())
+        {
+            const auto index = mFreeNodes.back();
+            mFreeNodes.pop_back();
+            mNodes[index] = std::move(node);
+            return index;
+        }
+        mNodes.push_back(std::move(node));
+        return static_cast<uint32_t>(mNodes.size() - 1);
+    }
+
+    void ReleaseNode(uint32_t aNode)
+    {
+        mNodes[aNode].Value = TValue {};
+        mFreeNodes.push_back(aNode);
+    }
+
+    /// Делит поддерево на значения меньше aValue и остальные
+    std::pair<uint32_t, uint32_t> Split(uint32_t aNode, const TValue& aValue)
+    {
+        if (aNode == Null)
+        {
+            return { Null, Null };
+        }
+
+        if (mLess(mNodes[aNode].Value, aValue))
+        {
+            auto [left, right] = Split(mNodes[aNode].Right, aValue);
+            mNodes[aNode].Right = left;
+            UpdateSize(aNode);
+            return { aNode, right };
+        }
+
+        auto [left, right] = Split(mNodes[aNode].Left, aValue);
+        mNodes[aNode].Left = right;
+        UpdateSize(aNode);
+        return { left, aNode };
+    }
+
+    /// Все значения aLeft меньше значений aRight
+    uint32_t Merge(uint32_t aLeft, uint32_t aRight)
+    {
+        if (aLeft == Null)
+        {
+            return aRight;
+        }
+        if (aRight == Null)
+        {
+            return aLeft;
+        }
+
+        if (mNodes[aLeft].Priority > mNodes[aRight].Priority)
+        {
+            mNodes[aLeft].Right = Merge(mNodes[aLeft].Right, aRight);
+            UpdateSize(aLeft);
+            return aLeft;
+        }
+
+        mNodes[aRight].Left = Merge(aLeft, mNodes[aRight].Left);
+        UpdateSize(aRight);
+        return aRight;
+    }
+
+    uint32_t Erase(uint32_t aNode, const TValue& aValue, bool& aIsErased)
+    {
+        if (aNode == Null)
+        {
+            return Null;
+        }
+
+        auto& node = mNodes[aNode];
+        if (mLess(aValue, node.Value))
+        {
+            const auto left = Erase(node.Left, aValue, aIsErased);
+            mNodes[aNode].Left = left;
+        }
+        else if (mLess(node.Value, aValue))
+        {
+            const auto right = Erase(node.Right, aValue, aIsErased);
+            mNodes[aNode].Right = right;
+        }
+        else
+        {
+            const auto merged = Merge(node.Left, node.Right);
+            ReleaseNode(aNode);
+            aIsErased = true;
+            return merged;
+        }
+
+        UpdateSize(aNode);
+        return aNode;
+    }
+};
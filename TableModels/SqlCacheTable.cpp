@@ -1,5 +1,8 @@
 #include "SqlCacheTable.h"
 
+#include <QSet>
+
+#include <algorithm>
 #include <stdexcept>
 
 SqlCacheTable::SqlCacheTable(
@@ -7,25 +10,31 @@ SqlCacheTable::SqlCacheTable(
     const QString& aTableName,
     const SqlFieldDescription* aFieldList,
     size_t aFieldListSize,
-    const QString& aPrimaryKey)
+    const QString& aPrimaryKey,
+    const QStringList& aHiddenFields,
+    bool aHasRevision)
     : mDatabase(aDatabase)
     , mTableName(aTableName)
+    , mHasRevision(aHasRevision)
 {
-    InitFieldStrings(aFieldList, aFieldListSize, aPrimaryKey);
+    InitFieldStrings(aFieldList, aFieldListSize, aPrimaryKey, aHiddenFields);
 }
 
 void SqlCacheTable::InitFieldStrings(
     const SqlFieldDescription* aFieldList,
     size_t aFieldListSize,
-    const QString& aPrimaryKey)
+    const QString& aPrimaryKey,
+    const QStringList& aHiddenFields)
 {
     mFieldList.clear();
+    mFieldTypes.clear();
     QStringList fieldTypes;
 
     for (size_t i = 0; i < aFieldListSize; ++i)
     {
         const SqlFieldDescription& fieldDescription = aFieldList[i];
         mFieldList.append(fieldDescription.mName);
+        mFieldTypes.push_back(fieldDescription.mType);
         QString fieldTypeName = QString("%1 %2")
             .arg(
                 fieldDescription.mName,
@@ -33,21 +42,43 @@ void SqlCacheTable::InitFieldStrings(
 
         if (aPrimaryKey == fieldDescription.mName)
         {
+            mPrimaryKeyIndex = static_cast<int>(i);
             fieldTypeName += " PRIMARY KEY";
         }
 
         fieldTypes.append(fieldTypeName);
     }
+    for (const auto& hiddenField : aHiddenFields)
+    {
+        fieldTypes.append(QString("%1 %2")
+            .arg(hiddenField, SqlQueryUtils::GetFieldTypeName(SqlFieldType::String)));
+    }
+    if (mHasRevision)
+    {
+        fieldTypes.append(QString("%1 %2")
+            .arg(SqlQueryUtils::RevisionColumn, SqlQueryUtils::GetFieldTypeName(SqlFieldType::Integer)));
+    }
     mFieldsWithTypes = fieldTypes.join(",");
     mFields = mFieldList.join(",");
+    mStoredColumnCount = static_cast<int>(mFieldList.size() + aHiddenFields.size() + (mHasRevision ? 1 : 0));
 
-    auto insertParametersList = CreateParameters(mFieldList.size());
+    auto insertParametersList = CreateParameters(mStoredColumnCount);
     mInsertItemQuery = QString("INSERT OR REPLACE INTO %1 VALUES (%2)")
         .arg(mTableName, insertParametersList);
+    mInsertItemsQuery = QString("INSERT OR REPLACE INTO %1 VALUES %2")
+        .arg(mTableName);
     mDeleteItemQuery = QString("DELETE FROM %1 WHERE id = ?;").arg(mTableName);
+    mDeleteItemsQuery = QString("DELETE FROM %1 WHERE id IN (%2);").arg(mTableName);
+    mCountItemsQuery = QString("SELECT count(1) FROM %1 WHERE id IN (%2)").arg(mTableName);
     mSelectItemQuery = QString("SELECT %1 FROM %2 WHERE id = ?")
         .arg(mFields)
         .arg(mTableName);
+    // Список параметров подставляется при выполнении, т.к. зависит от количества id.
+    mSelectItemsQuery = QString("SELECT %1 FROM %2 WHERE id IN (%3)")
+        .arg(mHasRevision ? mFields + "," + SqlQueryUtils::RevisionColumn : mFields)
+        .arg(mTableName);
+    mFullTextTableName = mTableName + "_fts";
+    mFullTextTriggerName = mTableName + "_fts_au";
     mCreateTableQuery = QString("CREATE TABLE %1 (%2);")
         .arg(mTableName, mFieldsWithTypes);
     // We make delete instead of drop. From sqlite docs:
@@ -58,7 +89,7 @@ void SqlCacheTable::InitFieldStrings(
     // occur.
     mClearTableQuery = QString("DELETE FROM %1;").arg(mTableName);
 
-    if (mFieldList.size() >= SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER)
+    if (mStoredColumnCount >= SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER)
     {
         throw std::runtime_error(
             QString("%1: Fields count more than Max")
@@ -76,6 +107,17 @@ QString SqlCacheTable::CreateParameters(int aSize)
     return parameterList.join(",");
 }
 
+QString SqlCacheTable::CreateRowsParameters(int aRowsCount) const
+{
+    const auto rowParameters = QString("(%1)").arg(CreateParameters(mStoredColumnCount));
+    QStringList rowList;
+    for (int i = 0; i < aRowsCount; ++i)
+    {
+        rowList.append(rowParameters);
+    }
+    return rowList.join(",");
+}
+
 void SqlCacheTable::PerformSql(
     const QString& aSql,
     const QVariantList& aParams,
@@ -85,28 +127,271 @@ void SqlCacheTable::PerformSql(
     auto sql = aSql;
     SqlQueryUtils::SpecifyQueryString(sql, mTableName, mFields, aFilter);
     PerformSqlInternal(sql, aParams, aIsForwardOnly);
+
+    /// Произвольный запрос мог изменить таблицу
+    if (!mLastQuery.isSelect())
+    {
+        mRowCount.reset();
+    }
+}
+
+QSqlQuery SqlCacheTable::PerformUncachedSql(
+    const QString& aSql,
+    const QVariantList& aParams,
+    const QString& aFilter)
+{
+    auto sql = aSql;
+    SqlQueryUtils::SpecifyQueryString(sql, mTableName, mFields, aFilter);
+    auto query = Prepare(sql, false);
+    ExecPrepared(query, aParams);
+
+    /// Произвольный запрос мог изменить таблицу
+    if (!query.isSelect())
+    {
+        mRowCount.reset();
+    }
+    return query;
 }
 
 void SqlCacheTable::PerformAction(Action aAction, const QVariant& aItem)
 {
     QString sql;
-    /// Для select и delete считаем, что это Id
+    /// Для select и delete считаем, что это Id, для SelectList и DeleteList - список Id,
+    /// для InsertList - список строк.
     
-    auto params = (aAction == Action::Select || aAction == Action::Delete)
-        ? (QVariantList {} << aItem)
-        : aItem.toList();
+    QVariantList params;
+    switch (aAction)
+    {
+    case Action::Select:
+    case Action::Delete:
+        params << aItem;
+        break;
+    case Action::InsertList:
+        for (const auto& row : aItem.toList())
+        {
+            params.append(row.toList());
+            if (mHasRevision)
+            {
+                params.append(++mRevision);
+            }
+        }
+        break;
+    default:
+        params = aItem.toList();
+        if (aAction == Action::Insert && mHasRevision)
+        {
+            params.append(++mRevision);
+        }
+        break;
+    }
     
     switch (aAction)
     {
     case Action::Create: sql = mCreateTableQuery; break;
     case Action::Clear: sql = mClearTableQuery; break;
     case Action::Select: sql = mSelectItemQuery; break;
+    case Action::SelectList: sql = mSelectItemsQuery.arg(CreateParameters(params.size())); break;
     case Action::Delete: sql = mDeleteItemQuery; break;
+    case Action::DeleteList: sql = mDeleteItemsQuery.arg(CreateParameters(params.size())); break;
     case Action::Insert: sql = mInsertItemQuery; break;
+    case Action::InsertList: sql = mInsertItemsQuery.arg(CreateRowsParameters(aItem.toList().size())); break;
     default: break;
     }
-    
-    PerformSqlInternal(sql, params);
+
+    /// INSERT OR REPLACE не сообщает, сколько строк заменено, поэтому
+    /// до вставки по первичному ключу считается, сколько ключей уже есть в таблице.
+    qlonglong newRowsCount = 0;
+    if (mRowCount)
+    {
+        if (aAction == Action::Insert)
+        {
+            newRowsCount = CountNewRows({ aItem });
+        }
+        else if (aAction == Action::InsertList)
+        {
+            newRowsCount = CountNewRows(aItem.toList());
+        }
+    }
+
+    switch (aAction)
+    {
+    case Action::Select:
+    case Action::Insert:
+    case Action::Delete:
+        ExecPrepared(GetActionQuery(aAction, sql), params);
+        break;
+    default:
+        PerformSqlInternal(sql, params);
+        break;
+    }
+
+    UpdateRowCount(aAction, newRowsCount);
+    if (HasFullTextIndex())
+    {
+        UpdateFullTextIndex(aAction, aItem);
+    }
+}
+
+void SqlCacheTable::UpdateFullTextIndex(Action aAction, const QVariant& aItem)
+{
+    QVariantList ids;
+    switch (aAction)
+    {
+    case Action::Clear:
+        ExecDirect(QString("DELETE FROM %1").arg(mFullTextTableName));
+        return;
+    case Action::Insert:
+        ids << aItem.toList().value(mPrimaryKeyIndex);
+        break;
+    case Action::InsertList:
+        for (const auto& row : aItem.toList())
+        {
+            ids << row.toList().value(mPrimaryKeyIndex);
+        }
+        break;
+    case Action::Delete:
+        ids << aItem;
+        break;
+    case Action::DeleteList:
+        ids = aItem.toList();
+        break;
+    default:
+        return;
+    }
+
+    const auto parameters = CreateParameters(ids.size());
+    PerformSqlInternal(
+        QString("DELETE FROM %1 WHERE rowid IN (%2)").arg(mFullTextTableName, parameters),
+        ids);
+
+    if (aAction == Action::Insert || aAction == Action::InsertList)
+    {
+        const auto columns = mFullTextColumns.join(",");
+        PerformSqlInternal(
+            QString("INSERT INTO %1(rowid,%2) SELECT id,%2 FROM %3 WHERE id IN (%4)")
+                .arg(mFullTextTableName, columns, mTableName, parameters),
+            ids);
+    }
+}
+
+void SqlCacheTable::CreateFullTextIndex(const QStringList& aColumns)
+{
+    if (aColumns.empty() || mPrimaryKeyIndex < 0)
+    {
+        throw std::runtime_error("CreateFullTextIndex: no columns or primary key");
+    }
+
+    const auto columns = aColumns.join(",");
+    QStringList newColumns;
+    for (const auto& column : aColumns)
+    {
+        newColumns << "new." + column;
+    }
+
+    /// detail=none уменьшает размер индекса, но допускает ложные совпадения,
+    /// поэтому исходное условие фильтра проверяется повторно.
+    ExecDirect(QString("CREATE VIRTUAL TABLE IF NOT EXISTS %1 USING fts5(%2, tokenize='trigram', detail=none)")
+        .arg(mFullTextTableName, columns));
+    ExecDirect(QString("DELETE FROM %1").arg(mFullTextTableName));
+    ExecDirect(QString("INSERT INTO %1(rowid,%2) SELECT id,%2 FROM %3")
+        .arg(mFullTextTableName, columns, mTableName));
+    ExecDirect(QString(
+        "CREATE TRIGGER IF NOT EXISTS %1 AFTER UPDATE OF %2 ON %3 BEGIN "
+        "DELETE FROM %4 WHERE rowid = old.id; "
+        "INSERT INTO %4(rowid,%2) VALUES (new.id,%5); "
+        "END")
+        .arg(mFullTextTriggerName, columns, mTableName, mFullTextTableName, newColumns.join(",")));
+
+    mFullTextColumns = aColumns;
+}
+
+void SqlCacheTable::DropFullTextIndex()
+{
+    mFullTextColumns.clear();
+    ExecDirect(QString("DROP TRIGGER IF EXISTS %1").arg(mFullTextTriggerName));
+    ExecDirect(QString("DROP TABLE IF EXISTS %1").arg(mFullTextTableName));
+}
+
+bool SqlCacheTable::HasFullTextIndex() const
+{
+    return !mFullTextColumns.empty();
+}
+
+const QString& SqlCacheTable::GetFullTextIndexName() const
+{
+    return mFullTextTableName;
+}
+
+const QStringList& SqlCacheTable::GetFullTextColumns() const
+{
+    return mFullTextColumns;
+}
+
+void SqlCacheTable::ExecDirect(const QString& aSql)
+{
+    QSqlQuery query { mDatabase };
+    if (!query.exec(aSql))
+    {
+        mLastQuery = query;
+        Throw();
+    }
+}
+
+qlonglong SqlCacheTable::CountNewRows(const QVariantList& aRows)
+{
+    if (mPrimaryKeyIndex < 0)
+    {
+        return aRows.size();
+    }
+
+    QSet<qlonglong> ids;
+    QVariantList params;
+    for (const auto& row : aRows)
+    {
+        const auto id = row.toList().value(mPrimaryKeyIndex);
+        if (!ids.contains(id.toLongLong()))
+        {
+            ids.insert(id.toLongLong());
+            params.append(id);
+        }
+    }
+
+    PerformSqlInternal(mCountItemsQuery.arg(CreateParameters(params.size())), params, true);
+    if (!mLastQuery.next())
+    {
+        throw std::runtime_error("CountNewRows: query is empty");
+    }
+
+    const auto existingCount = mLastQuery.value(0).toLongLong();
+    mLastQuery.finish();
+    return params.size() - existingCount;
+}
+
+void SqlCacheTable::UpdateRowCount(Action aAction, qlonglong aNewRowsCount)
+{
+    switch (aAction)
+    {
+    case Action::Create:
+    case Action::Clear:
+        mRowCount = 0;
+        break;
+    case Action::Insert:
+    case Action::InsertList:
+        if (mRowCount)
+        {
+            *mRowCount += aNewRowsCount;
+        }
+        break;
+    case Action::Delete:
+    case Action::DeleteList:
+        if (mRowCount)
+        {
+            *mRowCount -= mLastQuery.numRowsAffected();
+        }
+        break;
+    default:
+        break;
+    }
 }
 
 QSqlQuery& SqlCacheTable::GetLastQuery()
@@ -124,28 +409,116 @@ const QString& SqlCacheTable::GetName() const
     return mTableName;
 }
 
+const QString& SqlCacheTable::GetFields() const
+{
+    return mFields;
+}
+
 const QString& SqlCacheTable::GetColumnName(int aColumn) const
 {
     return mFieldList[aColumn];
 }
 
+SqlFieldType SqlCacheTable::GetColumnType(int aColumn) const
+{
+    return mFieldTypes.at(static_cast<size_t>(aColumn));
+}
+
 qlonglong SqlCacheTable::GetColumnCount() const
 {
     return static_cast<qlonglong>(mFieldList.size());
 }
 
+bool SqlCacheTable::HasRevision() const
+{
+    return mHasRevision;
+}
+
+int SqlCacheTable::GetMaxInsertRowsCount() const
+{
+    return SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER / mStoredColumnCount;
+}
+
 qlonglong SqlCacheTable::GetRowCount()
+{
+    if (!mRowCount)
+    {
+        mRowCount = CountRows();
+    }
+    return *mRowCount;
+}
+
+std::optional<qlonglong> SqlCacheTable::GetTrackedRowCount() const
+{
+    return mRowCount;
+}
+
+void SqlCacheTable::SetRowCount(qlonglong aRowCount)
+{
+    mRowCount = aRowCount;
+}
+
+void SqlCacheTable::InvalidateRowCount()
+{
+    mRowCount.reset();
+}
+
+void SqlCacheTable::CreateIndex(const QString& aName, const QString& aColumns)
+{
+    ExecDirect(QString("CREATE INDEX IF NOT EXISTS %1 ON %2 (%3)").arg(aName, mTableName, aColumns));
+}
+
+void SqlCacheTable::CreateFoldedColumnsTrigger(const QStringList& aColumns, const QString& aFoldFunction)
+{
+    if (aColumns.empty())
+    {
+        return;
+    }
+
+    QStringList assignments;
+    for (const auto& column : aColumns)
+    {
+        assignments << QString("%1%2 = %3(new.%1)").arg(column, SqlQueryUtils::FoldedColumnSuffix, aFoldFunction);
+    }
+
+    ExecDirect(QString(
+        "CREATE TRIGGER IF NOT EXISTS %1_folded_au AFTER UPDATE OF %2 ON %1 BEGIN "
+        "UPDATE %1 SET %3 WHERE id = new.id; "
+        "END")
+        .arg(mTableName, aColumns.join(","), assignments.join(",")));
+}
+
+void SqlCacheTable::DropIndex(const QString& aName)
+{
+    ExecDirect(QString("DROP INDEX IF EXISTS %1").arg(aName));
+}
+
+void SqlCacheTable::FinishQueries()
+{
+    mLastQuery.finish();
+    for (auto& actionQuery : mActionQueries)
+    {
+        actionQuery.second.finish();
+    }
+    for (auto& preparedQuery : mPreparedQueries)
+    {
+        preparedQuery.Query.finish();
+    }
+}
+
+qlonglong SqlCacheTable::CountRows()
 {
     auto sql = QString("SELECT count(1) FROM %1").arg(mTableName);
     PerformSqlInternal(sql, {});
 
     if (!mLastQuery.next())
     {
-        throw std::runtime_error("GetRowCount: query is empty");
+        throw std::runtime_error("CountRows: query is empty");
     }
 
-    const auto& record = mLastQuery.record();
-    return record.value(0).toLongLong();
+    const auto count = mLastQuery.record().value(0).toLongLong();
+    mLastQuery.finish();
+    return count;
 }
 
 void SqlCacheTable::PerformSqlInternal(
@@ -153,12 +526,15 @@ void SqlCacheTable::PerformSqlInternal(
     const QVariantList& aParams,
     bool aIsForwardOnly)
 {
-    mLastQuery = QSqlQuery { mDatabase };
-    mLastQuery.setForwardOnly(aIsForwardOnly);
-    if (!mLastQuery.prepare(aSql))
-    {
-        Throw();
-    }
+    ExecPrepared(GetPreparedQuery(aSql, aIsForwardOnly), aParams);
+}
+
+void SqlCacheTable::ExecPrepared(
+    QSqlQuery& aQuery,
+    const QVariantList& aParams)
+{
+    /// Копия разделяет результат с закэшированным запросом
+    mLastQuery = aQuery;
     for (int i = 0; i < aParams.size(); ++i)
     {
         mLastQuery.bindValue(i, aParams[i]);
@@ -169,6 +545,54 @@ void SqlCacheTable::PerformSqlInternal(
     }
 }
 
+QSqlQuery SqlCacheTable::Prepare(const QString& aSql, bool aIsForwardOnly)
+{
+    QSqlQuery query { mDatabase };
+    query.setForwardOnly(aIsForwardOnly);
+    if (!query.prepare(aSql))
+    {
+        mLastQuery = query;
+        Throw();
+    }
+    return query;
+}
+
+QSqlQuery& SqlCacheTable::GetPreparedQuery(const QString& aSql, bool aIsForwardOnly)
+{
+    auto it = std::find_if(
+        mPreparedQueries.begin(),
+        mPreparedQueries.end(),
+        [&](const PreparedQuery& aQuery)
+        {
+            return aQuery.IsForwardOnly == aIsForwardOnly && aQuery.Sql == aSql;
+        });
+
+    if (it != mPreparedQueries.end())
+    {
+        mPreparedQueries.splice(mPreparedQueries.begin(), mPreparedQueries, it);
+    }
+    else
+    {
+        mPreparedQueries.push_front(PreparedQuery { aSql, aIsForwardOnly, Prepare(aSql, aIsForwardOnly) });
+        if (mPreparedQueries.size() > PreparedQueriesCacheSize)
+        {
+            mPreparedQueries.pop_back();
+        }
+    }
+
+    return mPreparedQueries.front().Query;
+}
+
+QSqlQuery& SqlCacheTable::GetActionQuery(Action aAction, const QString& aSql)
+{
+    auto it = mActionQueries.find(aAction);
+    if (it == mActionQueries.end())
+    {
+        it = mActionQueries.emplace(aAction, Prepare(aSql, false)).first;
+    }
+    return it->second;
+}
+
 void SqlCacheTable::Throw() noexcept(false)
 {
     throw std::runtime_error(GetLastError().toStdString());
@@ -2,12 +2,26 @@
 
 #include "SqlQueryUtils.h"
 
+#include <list>
+#include <map>
+#include <optional>
+#include <vector>
+
 /// @class SqlCacheTable
 /// @brief Выполняет Sql-запросы к таблице в БД.
 /// Также позволяет создать Sql-таблицу.
 /// Удаление таблицы не поддерживается. Вместо этого можно очистить таблицу
 /// и затем использовать её заново.
 /// Методы, выполняющие Sql-запросы выбрасывают std::runtime_error в случае ошибки.
+/// Скрытые текстовые колонки хранятся после основных: они заполняются при вставке,
+/// но не возвращаются запросами Select и не учитываются в GetColumnCount.
+/// Если включена колонка _rev, она хранится последней: каждая вставка или замена строки
+/// записывает в неё следующее значение счетчика таблицы, а SelectList возвращает её
+/// последним значением строки.
+/// Подготовленные запросы переиспользуются: для стандартных действий они хранятся
+/// всё время жизни таблицы, для произвольных запросов - в LRU-кэше по тексту запроса.
+/// Количество строк отслеживается по результатам стандартных действий,
+/// поэтому полный подсчёт нужен только после произвольных изменений или отката.
 class SqlCacheTable
 {
 public:
@@ -17,8 +31,11 @@ public:
         Clear,
             
         Select,
+        SelectList,
         Insert,
-        Delete
+        InsertList,
+        Delete,
+        DeleteList
     };
     
     SqlCacheTable(
@@ -26,13 +43,22 @@ public:
         const QString& aTableName,
         const SqlFieldDescription* aFieldList,
         size_t aFieldListSize,
-        const QString& aPrimaryKey);
+        const QString& aPrimaryKey,
+        const QStringList& aHiddenFields = {},
+        bool aHasRevision = false);
 
    void PerformSql(
         const QString& aSql,
         const QVariantList& aParams,
         const QString& aFilter,
         bool aIsForwardOnly = false) noexcept(false);
+   /// Выполняет запрос на новом QSqlQuery, который не попадает в кэш подготовленных запросов.
+   /// Возвращенный запрос можно передавать наружу: его результат не изменится при повторном
+   /// выполнении того же текста запроса внутри таблицы.
+   QSqlQuery PerformUncachedSql(
+        const QString& aSql,
+        const QVariantList& aParams,
+        const QString& aFilter) noexcept(false);
    void PerformAction(
        Action aAction,
        const QVariant& aItem = QVariantList {}) noexcept(false);
@@ -40,10 +66,48 @@ public:
     QSqlQuery& GetLastQuery();
     QString GetLastError() const;
     const QString& GetName() const;
+    /// Список основных колонок через запятую
+    const QString& GetFields() const;
     const QString& GetColumnName(int aColumn) const;
+    SqlFieldType GetColumnType(int aColumn) const;
 
     qlonglong GetColumnCount() const;
+    bool HasRevision() const;
+    /// Список параметров вида "?,?,?"
+    static QString CreateParameters(int aSize);
+    /// Максимальное количество строк в одном запросе InsertList.
+    /// Строки для вставки содержат значения основных и скрытых колонок.
+    int GetMaxInsertRowsCount() const;
+    /// Возвращает отслеживаемое количество строк, при его отсутствии - считает полностью.
     qlonglong GetRowCount() noexcept(false);
+    /// Полный подсчёт строк запросом count(1). Используется для проверки согласованности.
+    qlonglong CountRows() noexcept(false);
+    /// Отслеживаемое количество строк без подсчёта
+    std::optional<qlonglong> GetTrackedRowCount() const;
+    /// Задаёт количество строк, например, по результату CountRows.
+    void SetRowCount(qlonglong aRowCount);
+    /// Сбрасывает отслеживаемое количество строк, например, после отката транзакции.
+    void InvalidateRowCount();
+
+    /// Создаёт индекс по списку колонок вида "col1 ASC, col2 DESC".
+    void CreateIndex(const QString& aName, const QString& aColumns) noexcept(false);
+    void DropIndex(const QString& aName) noexcept(false);
+    /// Создаёт триггер, который при изменении колонок aColumns через UPDATE
+    /// пересчитывает их скрытые копии <колонка>_folded функцией aFoldFunction.
+    void CreateFoldedColumnsTrigger(const QStringList& aColumns, const QString& aFoldFunction) noexcept(false);
+    /// Закрывает курсоры закэшированных запросов.
+    /// Изменение схемы при открытых курсорах невозможно.
+    void FinishQueries();
+
+    /// Создаёт полнотекстовый индекс FTS5 (trigram) по указанным колонкам и заполняет его.
+    /// Индекс хранится в таблице <имя>_fts, rowid которой совпадает с id.
+    /// Стандартные действия поддерживают индекс в актуальном состоянии,
+    /// изменения колонок через UPDATE отслеживаются триггером.
+    void CreateFullTextIndex(const QStringList& aColumns) noexcept(false);
+    void DropFullTextIndex() noexcept(false);
+    bool HasFullTextIndex() const;
+    const QString& GetFullTextIndexName() const;
+    const QStringList& GetFullTextColumns() const;
     
 private:
     QSqlDatabase& mDatabase;
@@ -52,27 +116,74 @@ private:
     QString mTableName;
     QString mFields;
     QStringList mFieldList;
+    std::vector<SqlFieldType> mFieldTypes;
     QString mFieldsWithTypes;
+    /// Количество колонок в таблице с учетом скрытых
+    int mStoredColumnCount = 0;
+    /// Индекс первичного ключа в списке полей или -1, если ключа нет
+    int mPrimaryKeyIndex = -1;
+    const bool mHasRevision;
+    /// Последнее значение, записанное в колонку _rev
+    qlonglong mRevision = 0;
     
     /// Запросы для выполнения стандартных действий
     QString mInsertItemQuery;
+    QString mInsertItemsQuery;
     QString mDeleteItemQuery;
+    QString mDeleteItemsQuery;
+    QString mCountItemsQuery;
     QString mSelectItemQuery;
+    QString mSelectItemsQuery;
     QString mCreateTableQuery;
     QString mClearTableQuery;
 
     /// Последний исполненный запрос
     QSqlQuery mLastQuery;
 
+    /// Точное количество строк в таблице, если оно известно
+    std::optional<qlonglong> mRowCount;
+
+    /// Полнотекстовый индекс. Пустой список колонок - индекс отсутствует.
+    QString mFullTextTableName;
+    QString mFullTextTriggerName;
+    QStringList mFullTextColumns;
+
+    struct PreparedQuery
+    {
+        QString Sql;
+        bool IsForwardOnly = false;
+        QSqlQuery Query;
+    };
+
+    static constexpr size_t PreparedQueriesCacheSize = 32;
+
+    /// Подготовленные запросы для Select, Insert и Delete
+    std::map<Action, QSqlQuery> mActionQueries;
+    /// Подготовленные произвольные запросы. В начале списка - последний использованный.
+    std::list<PreparedQuery> mPreparedQueries;
+
     void InitFieldStrings(
         const SqlFieldDescription* aFieldList,
         size_t aFieldListSize,
-        const QString& aPrimaryKey);
+        const QString& aPrimaryKey,
+        const QStringList& aHiddenFields);
     void PerformSqlInternal(
         const QString& aSql,
         const QVariantList& aParams,
         bool aIsForwardOnly = false) noexcept(false);
+    void ExecPrepared(
+        QSqlQuery& aQuery,
+        const QVariantList& aParams) noexcept(false);
+    QSqlQuery Prepare(const QString& aSql, bool aIsForwardOnly) noexcept(false);
+    QSqlQuery& GetPreparedQuery(const QString& aSql, bool aIsForwardOnly) noexcept(false);
+    QSqlQuery& GetActionQuery(Action aAction, const QString& aSql) noexcept(false);
+    /// Возвращает количество уникальных ключей aRows, которых нет в таблице.
+    /// Таблица не изменяется: выполняется только подсчет по первичному ключу.
+    qlonglong CountNewRows(const QVariantList& aRows) noexcept(false);
+    void UpdateRowCount(Action aAction, qlonglong aNewRowsCount);
+    void UpdateFullTextIndex(Action aAction, const QVariant& aItem) noexcept(false);
+    void ExecDirect(const QString& aSql) noexcept(false);
     [[ noreturn ]] void Throw() noexcept(false);
 
-    static QString CreateParameters(int aSize);
+    QString CreateRowsParameters(int aRowsCount) const;
 };
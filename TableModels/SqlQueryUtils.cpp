@@ -2,7 +2,9 @@
 #include "ColumnManager.h"
 
 #include <QDateTime>
+#include <QRegularExpression>
 
+#include <algorithm>
 #include <stdexcept>
 
 std::atomic_int64_t SqlQueryUtils::mInstanceCounter { 0 };
@@ -51,7 +53,10 @@ QString SqlQueryUtils::MakeUniqueName(const QString& aName)
     return QString("%1%2").arg(aName).arg(num + 1);
 }
 
-QString SqlQueryUtils::GetCommonFilter(const TextFilter& aFilter, const QString& aColumnExpression)
+QString SqlQueryUtils::GetCommonFilter(
+    const TextFilter& aFilter,
+    const QString& aColumnExpression,
+    bool aHasFoldedColumn)
 {
     QString res;
 
@@ -68,9 +73,13 @@ QString SqlQueryUtils::GetCommonFilter(const TextFilter& aFilter, const QString&
         res = "%1 GLOB '*%2*'";
     }
 
-    QString column = !aFilter.Mode.contains(FilterMode::CaseSensitive)
-            ? QString("LOWER(%1)").arg(aColumnExpression)
-            : aColumnExpression;
+    QString column = aColumnExpression;
+    if (!aFilter.Mode.contains(FilterMode::CaseSensitive))
+    {
+        column = aHasFoldedColumn
+            ? aColumnExpression + FoldedColumnSuffix
+            : QString("LOWER(%1)").arg(aColumnExpression);
+    }
 
     QString filter = !aFilter.Mode.contains(FilterMode::CaseSensitive)
             ? aFilter.Filter.toLower()
@@ -81,6 +90,71 @@ QString SqlQueryUtils::GetCommonFilter(const TextFilter& aFilter, const QString&
     return res;
 }
 
+QString SqlQueryUtils::GetFoldedColumnFilter(const QString& aFilter, const QStringList& aColumns)
+{
+    if (aColumns.empty())
+    {
+        return aFilter;
+    }
+
+    QStringList escapedColumns;
+    for (const auto& column : aColumns)
+    {
+        escapedColumns << QRegularExpression::escape(column);
+    }
+    const QRegularExpression lowerExpression(
+        QString(R"(\bLOWER\(\s*(%1)\s*\))").arg(escapedColumns.join("|")),
+        QRegularExpression::CaseInsensitiveOption);
+
+    auto result = aFilter;
+    result.replace(lowerExpression, QString("\\1%1").arg(FoldedColumnSuffix));
+    return result;
+}
+
+QString SqlQueryUtils::GetFullTextIndexFilter(
+    const QString& aFilter,
+    const QString& aFullTextTableName,
+    const QStringList& aColumns)
+{
+    /// trigram-токенизатор ищет подстроки от трех символов
+    static constexpr int MinSubstringLength = 3;
+
+    QStringList escapedColumns;
+    for (const auto& column : aColumns)
+    {
+        escapedColumns << QRegularExpression::escape(column);
+    }
+    const QRegularExpression globExpression(
+        QString(R"((?:LOWER\((%1)\)|\b(%1)(?:%2)?\b) GLOB '\*([^'*?\[\]]+)\*')")
+            .arg(escapedColumns.join("|"), QRegularExpression::escape(FoldedColumnSuffix)),
+        QRegularExpression::CaseInsensitiveOption);
+
+    QString result;
+    qsizetype position = 0;
+    auto it = globExpression.globalMatch(aFilter);
+    while (it.hasNext())
+    {
+        const auto match = it.next();
+        const auto substring = match.captured(3);
+        if (substring.size() < MinSubstringLength)
+        {
+            continue;
+        }
+
+        const auto column = match.captured(1).isEmpty() ? match.captured(2) : match.captured(1);
+        auto phrase = substring;
+        phrase.replace('"', "\"\"");
+
+        result.append(aFilter.mid(position, match.capturedStart() - position));
+        result.append(QString("(id IN (SELECT rowid FROM %1 WHERE %2 MATCH '\"%3\"') AND %4)")
+            .arg(aFullTextTableName, column, phrase, match.captured()));
+        position = match.capturedEnd();
+    }
+    result.append(aFilter.mid(position));
+
+    return result;
+}
+
 QString SqlQueryUtils::GetInstrumentFilter(const QString& aInstrument, bool aIsWithStandardContractSize)
 {
     QString filter;
@@ -138,6 +212,109 @@ QString SqlQueryUtils::GetFullTextSearchValue(const QVariantList& aValues, const
     return common;
 }
 
+namespace
+{
+
+/// Класс хранения SQLite, определяющий порядок значений разных типов
+int GetStorageClassRank(const QVariant& aValue)
+{
+    if (aValue.isNull())
+    {
+        return 0;
+    }
+
+    switch (aValue.userType())
+    {
+    case QMetaType::Bool:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Double:
+        return 1;
+    case QMetaType::QByteArray:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+bool IsIntegral(const QVariant& aValue)
+{
+    return aValue.userType() != QMetaType::Double;
+}
+
+/// Сравнение по кодовым точкам, что совпадает с побайтовым сравнением UTF-8 в SQLite.
+/// Для NOCASE, как и в SQLite, к нижнему регистру приводятся только ASCII-символы.
+int CompareStrings(const QString& aLeft, const QString& aRight, bool aIsNoCase)
+{
+    auto normalize = [aIsNoCase](QChar aChar)
+    {
+        auto code = aChar.unicode();
+        if (aIsNoCase && code >= 'A' && code <= 'Z')
+        {
+            code += 'a' - 'A';
+        }
+        /// Суррогатные пары идут после остальных символов BMP
+        if (code >= 0xD800)
+        {
+            code = code >= 0xE000 ? code - 0x800 : code + 0x2000;
+        }
+        return code;
+    };
+
+    const auto size = (std::min)(aLeft.size(), aRight.size());
+    for (decltype(aLeft.size()) i = 0; i < size; ++i)
+    {
+        const auto left = normalize(aLeft[i]);
+        const auto right = normalize(aRight[i]);
+        if (left != right)
+        {
+            return left < right ? -1 : 1;
+        }
+    }
+    return aLeft.size() == aRight.size() ? 0 : (aLeft.size() < aRight.size() ? -1 : 1);
+}
+
+}
+
+int SqlQueryUtils::CompareSqlValues(const QVariant& aLeft, const QVariant& aRight, bool aIsNoCase)
+{
+    const auto leftRank = GetStorageClassRank(aLeft);
+    const auto rightRank = GetStorageClassRank(aRight);
+    if (leftRank != rightRank)
+    {
+        return leftRank < rightRank ? -1 : 1;
+    }
+
+    switch (leftRank)
+    {
+    case 0:
+        return 0;
+    case 1:
+        if (IsIntegral(aLeft) && IsIntegral(aRight))
+        {
+            const auto left = aLeft.toLongLong();
+            const auto right = aRight.toLongLong();
+            return left == right ? 0 : (left < right ? -1 : 1);
+        }
+        else
+        {
+            const auto left = aLeft.toDouble();
+            const auto right = aRight.toDouble();
+            return left == right ? 0 : (left < right ? -1 : 1);
+        }
+    case 3:
+    {
+        const auto left = aLeft.toByteArray();
+        const auto right = aRight.toByteArray();
+        return left == right ? 0 : (left < right ? -1 : 1);
+    }
+    default:
+        return CompareStrings(aLeft.toString(), aRight.toString(), aIsNoCase);
+    }
+}
+
 QString SqlQueryUtils::GetFullTextSearchValue(const QVariantList& aValues)
 {
     std::set<int> indexes;
@@ -361,10 +538,15 @@ int RowRange::NearestRow(int aRow) const
 }
 
 RowRange RowRange::Expand(int aOffset) const
+{
+    return Expand(aOffset, aOffset);
+}
+
+RowRange RowRange::Expand(int aTopOffset, int aBottomOffset) const
 {
     RowRange newRange;
-    newRange.Top = qMax(0, Top - aOffset);
-    newRange.Bottom = qMax(newRange.Top, Bottom + aOffset);
+    newRange.Top = qMax(0, Top - aTopOffset);
+    newRange.Bottom = qMax(newRange.Top, Bottom + aBottomOffset);
 
     return newRange;
 }
@@ -62,6 +62,10 @@ struct SqlQueryUtils
     static constexpr char TablePlaceholder[] = "$table$";
     static constexpr char FieldsPlaceholder[] = "$fields$";
     static constexpr char FilterPlaceholder[] = "$filter$";
+    /// Суффикс скрытой колонки с приведенным к нижнему регистру значением колонки общего поиска
+    static constexpr char FoldedColumnSuffix[] = "_folded";
+    /// Скрытая колонка с номером изменения строки
+    static constexpr char RevisionColumn[] = "_rev";
 
     static constexpr int SQLITE_MAX_VARIABLE_NUMBER = 999; // from sqlite3.c: maximum number of SQL variables
     static constexpr int RowWindowOffset = 50;
@@ -73,7 +77,25 @@ struct SqlQueryUtils
     static QString GetFieldTypeName(const SqlFieldType& aType);
     static QString MakeUniqueName(const QString& aName);
 
-    static QString GetCommonFilter(const TextFilter& aFilter, const QString& aColumnExpression = "common");
+    /// Фильтр без учета регистра приводит значение к нижнему регистру функцией LOWER
+    /// при каждом сравнении. Если у колонки есть скрытая копия <aColumnExpression>_folded
+    /// (колонки общего поиска кэша), с aHasFoldedColumn = true фильтр сравнивает её.
+    static QString GetCommonFilter(
+        const TextFilter& aFilter,
+        const QString& aColumnExpression = "common",
+        bool aHasFoldedColumn = false);
+    /// Заменяет в фильтре "LOWER(col)" на "col_folded" для колонок aColumns,
+    /// у которых есть скрытая копия в нижнем регистре.
+    static QString GetFoldedColumnFilter(const QString& aFilter, const QStringList& aColumns);
+    /// Дополняет условия вида "col GLOB '*x*'", "col_folded GLOB '*x*'" или "LOWER(col) GLOB '*x*'",
+    /// построенные GetCommonFilter,
+    /// отбором кандидатов по полнотекстовому индексу:
+    /// "(id IN (SELECT rowid FROM fts WHERE col MATCH '"x"') AND <исходное условие>)".
+    /// Подстроки короче трех символов и шаблоны со спецсимволами не переписываются.
+    static QString GetFullTextIndexFilter(
+        const QString& aFilter,
+        const QString& aFullTextTableName,
+        const QStringList& aColumns);
 
     static QString GetInstrumentFilter(const QString& aInstrument, bool aIsWithStandardContractSize = false);
 
@@ -90,6 +112,11 @@ struct SqlQueryUtils
     static QString GetFullTextSearchValue(const QVariantList& aValues, const std::set<int>& aIndexes);
     static QString GetFullTextSearchValue(const QVariantList& aValues);
 
+    /// Сравнение значений, полученных из SQLite, в порядке ORDER BY:
+    /// NULL, затем числа, затем строки (BINARY или NOCASE), затем BLOB.
+    /// Возвращает отрицательное число, ноль или положительное число.
+    static int CompareSqlValues(const QVariant& aLeft, const QVariant& aRight, bool aIsNoCase);
+
     static QVariantList Record2Fields(const QSqlRecord& aRecord);
 
 private:
@@ -136,6 +163,7 @@ struct RowRange
     int Distance() const;// Bottom - Top
     int NearestRow(int aRow) const;
     RowRange Expand(int aOffset) const;
+    RowRange Expand(int aTopOffset, int aBottomOffset) const;
     int Count() const;
     RowRange ScrollTo(int aRow) const;
     RowRange ScrollToWithCorrection(
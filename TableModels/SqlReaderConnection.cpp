@@ -0,0 +1,182 @@
+#include "SqlReaderConnection.h"
+#include "SqlCacheTable.h"
+#include "SqliteUtils.h"
+
+#include <QFile>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+
+#include <algorithm>
+
+SqlReaderConnection::SqlReaderConnection(
+    const QString& aDatabaseName,
+    const QString& aTableName,
+    const QString& aFields,
+    int aIdColumn,
+    std::shared_ptr<const std::atomic_bool> aStopExport)
+    : mDatabaseName(aDatabaseName)
+    , mConnectionName(SqlQueryUtils::MakeUniqueName(aTableName + "_reader"))
+    , mTableName(aTableName)
+    , mFields(aFields)
+    , mIdColumn(aIdColumn)
+    , mStopExport(std::move(aStopExport))
+{
+}
+
+SqlReaderConnection::~SqlReaderConnection()
+{
+    if (mDatabase.isValid())
+    {
+        mDatabase.close();
+        mDatabase = QSqlDatabase {};
+        QSqlDatabase::removeDatabase(mConnectionName);
+    }
+}
+
+void SqlReaderConnection::Open()
+{
+    mDatabase = QSqlDatabase::addDatabase("QSQLITE", mConnectionName);
+    mDatabase.setDatabaseName(mDatabaseName);
+    mDatabase.setConnectOptions("QSQLITE_OPEN_READONLY");
+    if (!mDatabase.open())
+    {
+        emit Opened(false);
+        return;
+    }
+
+    SqliteUtils::RegisterRegexpFunction(mDatabase);
+    emit Opened(true);
+}
+
+void SqlReaderConnection::PerformSelect(QString aSql, QVariantList aParams, QString aFilter)
+{
+    SqlQueryUtils::SpecifyQueryString(aSql, mTableName, mFields, aFilter);
+
+    QSqlQuery query { mDatabase };
+    query.setForwardOnly(true);
+    bool isExecuted = query.prepare(aSql);
+    for (int i = 0; isExecuted && i < aParams.size(); ++i)
+    {
+        query.bindValue(i, aParams[i]);
+    }
+    isExecuted = isExecuted && query.exec();
+    if (!isExecuted)
+    {
+        emit ErrorOccured(query.lastError().text());
+        return;
+    }
+    if (!query.isSelect())
+    {
+        emit ErrorOccured("On_PerformSelect: only select statements allowed here");
+        return;
+    }
+
+    QVariantList result;
+    while (query.next())
+    {
+        const auto record = query.record();
+        QVariantList row;
+        for (int i = 0; i < record.count(); ++i)
+        {
+            row.push_back(record.value(i));
+        }
+        result.push_back(row);
+    }
+
+    emit SelectPerformed(result);
+}
+
+void SqlReaderConnection::Export(
+    QString aExportFileName,
+    ColumnsExportInfo aColumns,
+    QVector<qlonglong> aIds)
+{
+    CsvExporter exp(aExportFileName);
+    if(!exp.IsReadyForWrite())
+    {
+        emit ExportFinished("Export file is not valid");
+        return;
+    }
+
+    /// Записи читаются порциями, а не отдельным запросом на строку
+    std::unordered_map<qlonglong, QSqlRecord> records;
+    int loadedFrom = -1;
+    int i = -1;
+    QSqlRecord record;
+    QString error;
+
+    auto cellGetter = [&](int aRow, int aColumn)
+    {
+        if (aRow != i)
+        {
+            i = aRow;
+            const int chunk = aRow - aRow % SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER;
+            if (chunk != loadedFrom)
+            {
+                loadedFrom = chunk;
+                const auto loadError = LoadRecords(aIds, chunk, records);
+                if (error.isEmpty())
+                {
+                    error = loadError;
+                }
+            }
+            auto it = records.find(aIds[aRow]);
+            record = it != records.cend() ? it->second : QSqlRecord {};
+        }
+        return record.value(aColumn);
+    };
+
+    IterateTable(
+        aIds.size(),
+        cellGetter,
+        &exp,
+        aColumns,
+        0,
+        [this](int aProgress){ emit ExportProgressChanged(aProgress); },
+        [this](){ return mStopExport->load(); });
+
+    exp.CloseFile();
+    if (mStopExport->load())
+    {
+        QFile file( aExportFileName );
+        file.remove();
+    }
+    emit ExportFinished(error);
+}
+
+QString SqlReaderConnection::LoadRecords(
+    const QVector<qlonglong>& aIds,
+    int aFrom,
+    std::unordered_map<qlonglong, QSqlRecord>& aRecords)
+{
+    aRecords.clear();
+    const auto count = (std::min)(aIds.size() - aFrom, SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER);
+
+    auto sql = QString("SELECT %1 FROM %2 WHERE id IN (%3)")
+        .arg(SqlQueryUtils::FieldsPlaceholder)
+        .arg(SqlQueryUtils::TablePlaceholder)
+        .arg(SqlCacheTable::CreateParameters(count));
+    SqlQueryUtils::SpecifyQueryString(sql, mTableName, mFields, QString {});
+
+    QSqlQuery query { mDatabase };
+    query.setForwardOnly(true);
+    if (!query.prepare(sql))
+    {
+        return query.lastError().text();
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        query.bindValue(i, aIds[aFrom + i]);
+    }
+    if (!query.exec())
+    {
+        return query.lastError().text();
+    }
+
+    while (query.next())
+    {
+        const auto record = query.record();
+        aRecords.emplace(record.value(mIdColumn).toLongLong(), record);
+    }
+    return QString {};
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QObject>
+#include <QVector>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlRecord>
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+#include "export/Exporter.h"
+
+/// @class SqlReaderConnection
+/// @brief Отдельное соединение только для чтения к файловому хранилищу в режиме WAL.
+/// Живет в потоке из DbThreadPool и выполняет пользовательские запросы и экспорт,
+/// не занимая поток записи. Видит последнее зафиксированное состояние таблицы.
+/// Соединение открывается и закрывается в потоке объекта.
+class SqlReaderConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    SqlReaderConnection(
+        const QString& aDatabaseName,
+        const QString& aTableName,
+        const QString& aFields,
+        int aIdColumn,
+        std::shared_ptr<const std::atomic_bool> aStopExport);
+    virtual ~SqlReaderConnection() override;
+
+public slots:
+    void Open();
+    /// Пользовательский запрос с подстановками $table$, $fields$, $filter$.
+    void PerformSelect(QString aSql, QVariantList aParams, QString aFilter);
+    /// Экспорт строк aIds в указанном порядке.
+    void Export(
+        QString aExportFileName,
+        ColumnsExportInfo aColumns,
+        QVector<qlonglong> aIds);
+
+signals:
+    void Opened(bool aIsOpen);
+    void SelectPerformed(QVariantList aResults);
+    void ErrorOccured(const QString& aError);
+    void ExportProgressChanged(int aProgress);
+    void ExportFinished(const QString& aError);
+
+private:
+    const QString mDatabaseName;
+    const QString mConnectionName;
+    const QString mTableName;
+    const QString mFields;
+    const int mIdColumn;
+    /// Общий с хранилищем: читатель удаляется асинхронно и может пережить его
+    const std::shared_ptr<const std::atomic_bool> mStopExport;
+    QSqlDatabase mDatabase;
+
+    /// Загружает записи aIds[aFrom, aFrom + SQLITE_MAX_VARIABLE_NUMBER) в aRecords.
+    /// Возвращает текст ошибки или пустую строку.
+    QString LoadRecords(
+        const QVector<qlonglong>& aIds,
+        int aFrom,
+        std::unordered_map<qlonglong, QSqlRecord>& aRecords);
+};
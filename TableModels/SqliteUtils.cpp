@@ -0,0 +1,255 @@
+#include "TableModels/SqliteUtils.h"
+
+#include <QRegularExpression>
+#include <QtSql/QSqlDriver>
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace
+{
+
+/// Скомпилированный шаблон REGEXP
+class RegexpPattern
+{
+public:
+    explicit RegexpPattern(const QString& aPattern)
+    {
+        static const QString wordBoundary = "\\b";
+
+        if (IsLiteral(aPattern))
+        {
+            mLiteral = aPattern.toStdString();
+        }
+        else if (IsWholeWordLiteral(aPattern, wordBoundary))
+        {
+            mLiteral = aPattern.mid(wordBoundary.size(), aPattern.size() - 2 * wordBoundary.size()).toStdString();
+            mIsWholeWord = true;
+        }
+        else
+        {
+            mExpression = QRegularExpression(aPattern);
+            /// Компилируем (с JIT, если доступен) сразу, а не при первом сравнении
+            mExpression->optimize();
+        }
+    }
+
+    bool IsValid() const
+    {
+        return !mExpression || mExpression->isValid();
+    }
+
+    QString GetError() const
+    {
+        return mExpression ? mExpression->errorString() : QString {};
+    }
+
+    bool Match(std::string_view aValue) const
+    {
+        if (mExpression)
+        {
+            return mExpression->match(QString::fromUtf8(aValue.data(), static_cast<int>(aValue.size()))).hasMatch();
+        }
+
+        if (!mIsWholeWord)
+        {
+            return aValue.find(mLiteral) != std::string_view::npos;
+        }
+
+        for (auto pos = aValue.find(mLiteral); pos != std::string_view::npos; pos = aValue.find(mLiteral, pos + 1))
+        {
+            const auto end = pos + mLiteral.size();
+            const bool isWordStart = pos == 0 || !IsWordCharacter(aValue[pos - 1]);
+            const bool isWordEnd = end == aValue.size() || !IsWordCharacter(aValue[end]);
+            if (isWordStart && isWordEnd)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::optional<QRegularExpression> mExpression;
+    /// Искомая подстрока в UTF-8
+    std::string mLiteral;
+    bool mIsWholeWord = false;
+
+    static bool IsLiteral(const QString& aPattern)
+    {
+        static const QString metaCharacters = "\\.^$|?*+()[]{}";
+        return std::none_of(aPattern.cbegin(), aPattern.cend(), [](QChar aChar)
+        {
+            return metaCharacters.contains(aChar);
+        });
+    }
+
+    /// Шаблон "\bслово\b", где слово начинается и заканчивается символом слова.
+    /// Иначе \b требует символа слова с внешней стороны и поиском подстроки не заменяется.
+    static bool IsWholeWordLiteral(const QString& aPattern, const QString& aWordBoundary)
+    {
+        if (aPattern.size() <= 2 * aWordBoundary.size()
+            || !aPattern.startsWith(aWordBoundary)
+            || !aPattern.endsWith(aWordBoundary))
+        {
+            return false;
+        }
+
+        const auto word = aPattern.mid(aWordBoundary.size(), aPattern.size() - 2 * aWordBoundary.size());
+        return IsLiteral(word)
+            && word.front().unicode() < 0x80 && IsWordCharacter(static_cast<char>(word.front().unicode()))
+            && word.back().unicode() < 0x80 && IsWordCharacter(static_cast<char>(word.back().unicode()));
+    }
+
+    /// Совпадает с \w в QRegularExpression без UseUnicodePropertiesOption:
+    /// словом считаются только ASCII буквы, цифры и '_'.
+    /// Байты многобайтовых символов UTF-8 границу слова не продолжают.
+    static bool IsWordCharacter(char aChar)
+    {
+        return (aChar >= 'a' && aChar <= 'z')
+            || (aChar >= 'A' && aChar <= 'Z')
+            || (aChar >= '0' && aChar <= '9')
+            || aChar == '_';
+    }
+};
+
+std::string_view GetText(sqlite3_value* aValue)
+{
+    return std::string_view(
+        reinterpret_cast<const char*>(sqlite3_value_text(aValue)),
+        static_cast<size_t>(sqlite3_value_bytes(aValue)));
+}
+
+void DeletePattern(void* aPattern)
+{
+    delete static_cast<RegexpPattern*>(aPattern);
+}
+
+/// Количество инструкций VM SQLite между проверками прерывания
+constexpr int InterruptionCheckInstructions = 1000;
+
+int CheckInterruption(void* aInterruption)
+{
+    return static_cast<const QueryInterruption*>(aInterruption)->IsInterrupted() ? 1 : 0;
+}
+
+sqlite3* GetHandle(const QSqlDatabase& aDatabase)
+{
+    const auto handle = aDatabase.driver()->handle();
+    if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0)
+    {
+        return nullptr;
+    }
+    return *static_cast<sqlite3* const*>(handle.constData());
+}
+
+void Regexp(sqlite3_context* aContext, int /*aArgc*/, sqlite3_value** aArgv)
+{
+    if (sqlite3_value_type(aArgv[0]) == SQLITE_NULL
+        || sqlite3_value_type(aArgv[1]) == SQLITE_NULL)
+    {
+        sqlite3_result_null(aContext);
+        return;
+    }
+
+    std::optional<RegexpPattern> localPattern;
+    const auto* pattern = static_cast<const RegexpPattern*>(sqlite3_get_auxdata(aContext, 0));
+    if (!pattern)
+    {
+        const auto patternText = GetText(aArgv[0]);
+        localPattern.emplace(QString::fromUtf8(patternText.data(), static_cast<int>(patternText.size())));
+        if (!localPattern->IsValid())
+        {
+            sqlite3_result_error(aContext, localPattern->GetError().toUtf8().constData(), -1);
+            return;
+        }
+        pattern = &*localPattern;
+        /// SQLite может удалить auxdata сразу, поэтому сохраняем копию,
+        /// а в этом вызове используем локальный шаблон.
+        /// Копия QRegularExpression разделяет скомпилированные данные.
+        sqlite3_set_auxdata(aContext, 0, new RegexpPattern(*localPattern), &DeletePattern);
+    }
+
+    sqlite3_result_int(aContext, pattern->Match(GetText(aArgv[1])) ? 1 : 0);
+}
+
+void FoldCase(sqlite3_context* aContext, int /*aArgc*/, sqlite3_value** aArgv)
+{
+    if (sqlite3_value_type(aArgv[0]) == SQLITE_NULL)
+    {
+        sqlite3_result_null(aContext);
+        return;
+    }
+
+    const auto text = GetText(aArgv[0]);
+    const auto folded = QString::fromUtf8(text.data(), static_cast<int>(text.size())).toLower().toUtf8();
+    sqlite3_result_text(aContext, folded.constData(), folded.size(), SQLITE_TRANSIENT);
+}
+
+}
+
+bool QueryInterruption::IsInterrupted() const
+{
+    const auto runningId = RunningId.load(std::memory_order_relaxed);
+    return runningId != 0 && runningId <= InterruptedId.load(std::memory_order_relaxed);
+}
+
+bool SqliteUtils::RegisterRegexpFunction(const QSqlDatabase& aDatabase)
+{
+    auto* db = GetHandle(aDatabase);
+    if (!db)
+    {
+        return false;
+    }
+
+    return sqlite3_create_function_v2(
+        db,
+        "regexp",
+        2,
+        SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+        nullptr,
+        &Regexp,
+        nullptr,
+        nullptr,
+        nullptr) == SQLITE_OK;
+}
+
+bool SqliteUtils::RegisterFoldCaseFunction(const QSqlDatabase& aDatabase)
+{
+    auto* db = GetHandle(aDatabase);
+    if (!db)
+    {
+        return false;
+    }
+
+    return sqlite3_create_function_v2(
+        db,
+        FoldCaseFunction,
+        1,
+        SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+        nullptr,
+        &FoldCase,
+        nullptr,
+        nullptr,
+        nullptr) == SQLITE_OK;
+}
+
+bool SqliteUtils::SetInterruptionHandler(const QSqlDatabase& aDatabase, const QueryInterruption* aInterruption)
+{
+    auto* db = GetHandle(aDatabase);
+    if (!db)
+    {
+        return false;
+    }
+
+    sqlite3_progress_handler(
+        db,
+        aInterruption ? InterruptionCheckInstructions : 0,
+        aInterruption ? &CheckInterruption : nullptr,
+        const_cast<QueryInterruption*>(aInterruption));
+    return true;
+}
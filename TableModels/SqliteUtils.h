@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QtSql/QSqlDatabase>
+
+#include <atomic>
+
+/// @struct QueryInterruption
+/// @brief Состояние прерывания запроса, разделяемое потоком хранилища и front-потоком.
+/// Запрос прерывается, если выполняется запрос RunningId и запрошено прерывание
+/// для него или более нового запроса (id запросов возрастают).
+struct QueryInterruption
+{
+    /// 0 - прерываемый запрос не выполняется
+    std::atomic<qint64> RunningId { 0 };
+    std::atomic<qint64> InterruptedId { 0 };
+
+    bool IsInterrupted() const;
+};
+
+/// @struct SqliteUtils
+/// @brief Пользовательские функции SQLite, регистрируемые на соединении кэша.
+struct SqliteUtils
+{
+    /// Имя функции, регистрируемой RegisterFoldCaseFunction
+    static constexpr char FoldCaseFunction[] = "fold_case";
+
+    /// Регистрирует реализацию REGEXP (regexp(pattern, value)).
+    /// Шаблон компилируется один раз на запрос и хранится в auxdata SQLite.
+    /// Шаблоны без спецсимволов и вида "\bслово\b" проверяются поиском подстроки.
+    /// Возвращает false, если драйвер соединения не SQLite или регистрация не удалась.
+    static bool RegisterRegexpFunction(const QSqlDatabase& aDatabase);
+    /// Регистрирует fold_case(value): приведение к нижнему регистру QString::toLower,
+    /// так же, как при заполнении скрытых колонок *_folded при вставке.
+    static bool RegisterFoldCaseFunction(const QSqlDatabase& aDatabase);
+    /// Устанавливает progress handler, который прерывает запрос (SQLITE_INTERRUPT),
+    /// если aInterruption->IsInterrupted(). aInterruption должен жить дольше соединения
+    /// или до вызова с nullptr.
+    static bool SetInterruptionHandler(const QSqlDatabase& aDatabase, const QueryInterruption* aInterruption);
+};
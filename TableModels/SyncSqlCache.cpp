@@ -1,14 +1,18 @@
 #include "SyncSqlCache.h"
+#include "DbThreadPool.h"
 #include "Tracer.h"
 
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlDriver>
 #include <QtSql/QSqlField>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QTimer>
 #include <QApplication>
 #include <QtConcurrent/QtConcurrent>
 
+#include <utility>
+
 const QVariantList *ViewWindowValues::GetRow(int aRow) const
 {
     if (aRow >= RecordsCount)
@@ -29,7 +33,22 @@ const QVariantList *ViewWindowValues::GetRow(int aRow) const
 
 QVariantList *ViewWindowValues::GetRow(int aRow)
 {
-    return const_cast<QVariantList*>(static_cast<const ViewWindowValues*>(this)->GetRow(aRow));
+    if (!static_cast<const ViewWindowValues*>(this)->GetRow(aRow))
+    {
+        return nullptr;
+    }
+    /// Неконстантный operator[] отделяет блок, разделяемый с другим потоком
+    return &Data[aRow - Rows.Top];
+}
+
+qint64 ViewWindowValues::GetRowStamp(int aRow) const
+{
+    if (!GetRow(aRow))
+    {
+        return 0;
+    }
+    const auto index = aRow - Rows.Top;
+    return index < Stamps.size() ? Stamps[index] : -1;
 }
 
 RowRange ViewWindowValues::PrepareRemoveRows(int aRecordsCount) const
@@ -47,17 +66,17 @@ RowRange ViewWindowValues::PrepareRemoveRows(int aRecordsCount) const
 void ViewWindowValues::RemoveRows(int aRecordsCount)
 {
     aRecordsCount = qMax(0, aRecordsCount);
-    while (Rows.Bottom >= aRecordsCount)
+    if (Rows.Bottom >= aRecordsCount)
     {
-        if (GetRow(Rows.Bottom))
-        {
-            Data.removeLast();
-        }
-        --Rows.Bottom;
+        /// Блок строк разделяется с хранилищем, поэтому не изменяется:
+        /// строки за новой границей только выходят из диапазона Rows.
+        Rows.Bottom = aRecordsCount - 1;
         RowsVisible.Top = qMin(RowsVisible.Top, Rows.Bottom);
     }
-    if (Data.empty())
+    if (Data.empty() || Rows.Bottom < Rows.Top)
     {
+        Data = TRowBlock {};
+        Stamps.clear();
         Rows = RowRange {};
         RowsVisible = RowRange {};
     }
@@ -71,18 +90,32 @@ QVector<RowRange> ViewWindowValues::PrepareChangeRows(const ViewWindowValues& aN
     auto unitedRows = Rows.Union(aNewValues.Rows);
     for (auto it = unitedRows.cbegin(); it != unitedRows.cend(); ++it)
     {
-        if (it->Bottom < minRecordsCount)
+        /// В результат попадают только подряд идущие строки с разными метками
+        RowRange changedRange;
+        const auto bottom = qMin(it->Bottom, minRecordsCount - 1);
+        for (int row = it->Top; row <= bottom; ++row)
         {
-            result.push_back(*it);
-        }
-        else
-        {
-            RowRange changedRange = *it;
-            changedRange.Bottom = minRecordsCount - 1;
+            const auto oldStamp = GetRowStamp(row);
+            const auto newStamp = aNewValues.GetRowStamp(row);
+            if (oldStamp >= 0 && newStamp >= 0 && oldStamp == newStamp)
+            {
+                continue;
+            }
+
+            if (changedRange.IsValid() && changedRange.Bottom == row - 1)
+            {
+                changedRange.Bottom = row;
+                continue;
+            }
             if (changedRange.IsValid())
             {
                 result.push_back(changedRange);
             }
+            changedRange = RowRange { row, row };
+        }
+        if (changedRange.IsValid())
+        {
+            result.push_back(changedRange);
         }
     }
     return result;
@@ -93,6 +126,8 @@ void ViewWindowValues::ChangeRows(const ViewWindowValues& aNewValues)
     Rows = aNewValues.Rows;
     RowsVisible = aNewValues.RowsVisible;
     Data = aNewValues.Data;
+    Stamps = aNewValues.Stamps;
+    RowFetchCostUs = aNewValues.RowFetchCostUs;
 }
 
 RowRange ViewWindowValues::PrepareAddRows(int aRecordsCount) const
@@ -113,12 +148,14 @@ void ViewWindowValues::AddRows(int aRecordsCount)
 }
 
 void ViewWindowValues::SetData(
-    const QList<QVariantList>& aData,
+    const TRowBlock& aData,
+    const QVector<qint64>& aStamps,
     const RowRange& aRows,
     const RowRange& aRowsVisible,
     const int aRecordsCount)
 {
     Data = aData;
+    Stamps = aStamps;
     Rows = aRows;
     RowsVisible = aRowsVisible;
     RecordsCount = aRecordsCount;
@@ -136,9 +173,11 @@ SyncSqlCache::SyncSqlCache(
     Qt::SortOrder aDefaultSortDirection,
     QObject* aParent,
     bool aIsFile,
-    const QPointer<TableOperationHandlerBase>& aHandler)
+    const QPointer<TableOperationHandlerBase>& aHandler,
+    bool aTrackRevisions)
     : QObject(aParent)
     , mCommonFieldsIndexes(aCommonFieldsIndexes)
+    , mIdColumn(aIdColumn)
     , mSortOrder(aDefaultSortDirection)
     , mDefaultSortOrder(MakeDefaultSortOrder(aDefaultSortOrder, static_cast<int>(aFieldListSize), aIdColumn))
     , mDefaultSortDirection(aDefaultSortDirection)
@@ -148,7 +187,9 @@ SyncSqlCache::SyncSqlCache(
         SqlQueryUtils::MakeUniqueName(aTableName),
         aFieldList,
         aFieldListSize,
-        aPrimaryKey)
+        aPrimaryKey,
+        MakeFoldedFields(aFieldList, aCommonFieldsIndexes),
+        aTrackRevisions)
     , mSuspendedItemsTable(
         mDbConnection.GetDatabase(),
         mTable.GetName() + "_ssp", // ssp - suspended
@@ -158,6 +199,7 @@ SyncSqlCache::SyncSqlCache(
     , mSqlCacheTracer(
         GetTracer(
             QString("model.%1.sync").arg(mTable.GetName()).toStdString().c_str()))
+    , mIsFile(aIsFile)
 {
     if (!QMetaType(qMetaTypeId<ViewWindowValues>()).isRegistered())
     {
@@ -223,10 +265,15 @@ SyncSqlCache::SyncSqlCache(
     mSqlCacheTracer.Info("QSqlDriver::EventNotifications: " + QString::number(mDbConnection.GetDatabase().driver()->hasFeature(QSqlDriver::EventNotifications)));
 
     SetOperationHandler(aHandler);
+
+    mSortIndexesTimer.setSingleShot(true);
+    mSortIndexesTimer.setInterval(SortIndexesIdleTimeoutMs);
+    mSortIndexesTimer.callOnTimeout(this, &SyncSqlCache::MaintainSortIndexes);
 }
 
 SyncSqlCache::~SyncSqlCache()
 {
+    StopReaderConnection();
 }
 
 void SyncSqlCache::ReportError(const QString& aContext)
@@ -237,6 +284,11 @@ void SyncSqlCache::ReportError(const QString& aContext)
 
 void SyncSqlCache::InitDbTable()
 {
+    if (!SqliteUtils::RegisterRegexpFunction(mDbConnection.GetDatabase()))
+    {
+        mSqlCacheTracer.Warning(QString("%1: REGEXP function is not registered").arg(Q_FUNC_INFO));
+    }
+
     try
     {
         mTable.PerformAction(SqlCacheTable::Action::Create);
@@ -244,6 +296,29 @@ void SyncSqlCache::InitDbTable()
     }
     catch(std::runtime_error&) { ReportError(Q_FUNC_INFO); }
 
+    /// Плагин может изменить колонки общего поиска через UPDATE в ProcessDataInserted.
+    /// Без триггера копии *_folded устаревают, и фильтр сравнивает LOWER() исходных колонок.
+    if (SqliteUtils::RegisterFoldCaseFunction(mDbConnection.GetDatabase()))
+    {
+        try
+        {
+            mTable.CreateFoldedColumnsTrigger(GetCommonColumns(), SqliteUtils::FoldCaseFunction);
+            mUseFoldedColumns = true;
+        }
+        catch(std::runtime_error&)
+        {
+            mSqlCacheTracer.Warning(QString("%1: %2").arg(Q_FUNC_INFO).arg(mTable.GetLastError()));
+        }
+    }
+    else
+    {
+        mSqlCacheTracer.Warning(QString("%1: fold_case function is not registered").arg(Q_FUNC_INFO));
+    }
+
+    /// Индекс для сортировки по умолчанию строится первым
+    TouchSortIndex();
+    SetFullTextIndex(mUseFullTextIndex);
+
     emit InitializationCompleted();
 }
 
@@ -255,15 +330,26 @@ int SyncSqlCache::GetRecordsCount() const
         return 0;
     }
 
-    return static_cast<int>(it->second.Ids.size());
+    return static_cast<int>(it->second.GetSize());
 }
 
 QSqlQuery SyncSqlCache::PerformSqlUnsafe(
     const QString& aSql,
     const QVariantList& aParams) noexcept(false)
 {
-    mTable.PerformSql(aSql, aParams, mFilter);
-    return mTable.GetLastQuery();
+    /// Запрос отдается наружу, поэтому не должен разделять результат с кэшем подготовленных запросов
+    auto query = mTable.PerformUncachedSql(aSql, aParams, mFilter);
+    if (!query.isSelect())
+    {
+        /// Произвольный запрос изменяет строки без обновления _rev и без учета в mBatchChanges,
+        /// поэтому вектор id и индекс ключей сортировки больше не соответствуют таблице
+        mIsIdMappingActual = false;
+        mSortKeyIndex.reset();
+        mViewWindowRevisions.clear();
+        ClearRowCache();
+        ++mRowsRevision;
+    }
+    return query;
 }
 QSqlQuery SyncSqlCache::PerformSqlSafe(
     const QString& aSql,
@@ -279,19 +365,13 @@ QSqlQuery SyncSqlCache::PerformSqlSafe(
 
 QSqlRecord SyncSqlCache::GetRecord(int aRow)
 {
-    auto it = mVersionedIds.find(mViewWindowValues.Version);
-    if (it == mVersionedIds.cend())
-    {
-        return QSqlRecord {};
-    }
-
-    const auto& ids = it->second;
-    if (ids.IsOutOfRange(aRow))
+    const auto* ids = GetCurrentIdMapping();
+    if (!ids || ids->IsOutOfRange(aRow))
     {
         return QSqlRecord {};
     }
 
-    const auto& rowId = ids.GetId(aRow);
+    const auto& rowId = ids->GetId(aRow);
     if (!rowId.isValid())
     {
         return QSqlRecord {};
@@ -311,7 +391,10 @@ QSqlRecord SyncSqlCache::GetItem(const QVariant& aId)
         return QSqlRecord {};
     }
 
-    return query.record();
+    auto record = query.record();
+    /// Подготовленный запрос переиспользуется, поэтому освобождаем курсор сразу.
+    query.finish();
+    return record;
 }
 
 QVariantList SyncSqlCache::GetItemValues(const QVariant& aId)
@@ -319,6 +402,51 @@ QVariantList SyncSqlCache::GetItemValues(const QVariant& aId)
     return SqlQueryUtils::Record2Fields(GetItem(aId));
 }
 
+std::unordered_map<qlonglong, QVariantList> SyncSqlCache::GetItemsValues(
+    const std::vector<qlonglong>& aIds,
+    std::unordered_map<qlonglong, qlonglong>* outRevisions)
+{
+    std::unordered_map<qlonglong, QVariantList> result;
+    result.reserve(aIds.size());
+
+    /// Количество id в одном запросе ограничено количеством параметров sqlite.
+    const auto chunkSize = static_cast<size_t>(SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER);
+    for (size_t chunkBegin = 0; chunkBegin < aIds.size(); chunkBegin += chunkSize)
+    {
+        const auto chunkEnd = (std::min)(aIds.size(), chunkBegin + chunkSize);
+
+        QVariantList chunk;
+        chunk.reserve(static_cast<int>(chunkEnd - chunkBegin));
+        for (auto i = chunkBegin; i < chunkEnd; ++i)
+        {
+            chunk.push_back(aIds[i]);
+        }
+
+        try { mTable.PerformAction(SqlCacheTable::Action::SelectList, chunk); }
+        catch (std::runtime_error&)
+        {
+            ReportError(Q_FUNC_INFO);
+            return result;
+        }
+
+        auto& query = mTable.GetLastQuery();
+        while (query.next())
+        {
+            auto row = SqlQueryUtils::Record2Fields(query.record());
+            /// _rev выбирается последней колонкой
+            const auto revision = mTable.HasRevision() ? row.takeLast().toLongLong() : 0;
+            const auto id = row.value(mIdColumn).toLongLong();
+            if (outRevisions && mTable.HasRevision())
+            {
+                (*outRevisions)[id] = revision;
+            }
+            result.emplace(id, std::move(row));
+        }
+    }
+
+    return result;
+}
+
 const QString& SyncSqlCache::GetTableName() const
 {
     return mTable.GetName();
@@ -334,6 +462,17 @@ const SyncSqlCache::IdsInfo* SyncSqlCache::GetIdMapping() const
     return &mVersionedIds.rbegin()->second;
 }
 
+const SyncSqlCache::IdsInfo* SyncSqlCache::GetCurrentIdMapping() const
+{
+    auto it = mVersionedIds.find(mViewWindowValues.Version);
+    if (it == mVersionedIds.cend())
+    {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+
 const std::tuple<std::optional<std::set<qlonglong>>, std::optional<qlonglong>> SyncSqlCache::GetSelectedIds() const
 {
     std::optional<std::set<qlonglong>> selectedIds;
@@ -352,7 +491,7 @@ const std::tuple<std::optional<std::set<qlonglong>>, std::optional<qlonglong>> S
 
             for (auto row = range.Top; row <= range.Bottom; ++row)
             {
-                const auto id = ids->Ids[static_cast<size_t>(row)];
+                const auto id = ids->GetIdAt(static_cast<size_t>(row));
                 if (!topSelectedId)
                 {
                     topSelectedId = id;
@@ -394,41 +533,177 @@ SqlQueryUtils::TSortOrder SyncSqlCache::MakeDefaultSortOrder(
     return order;
 }
 
-void SyncSqlCache::UpdateViewWindowValues(bool aRefreshAll)
+void SyncSqlCache::UpdateViewWindowValues(
+    bool aRefreshAll,
+    const std::unordered_set<qlonglong>& aRefreshedIds)
 {
-    UpdateViewWindowValuesInternal(aRefreshAll);
+    UpdateViewWindowValuesInternal(aRefreshAll, aRefreshedIds);
     UpdateExtraData();
 }
 
-void SyncSqlCache::UpdateViewWindowValuesInternal(bool aRefreshAll)
+void SyncSqlCache::UpdateViewWindowValuesInternal(
+    bool aRefreshAll,
+    const std::unordered_set<qlonglong>& aRefreshedIds)
 {
     ViewWindowValues newValues;
-    if (mRequestedRowRange.IsValid())
+    const auto* ids = GetCurrentIdMapping();
+    if (mRequestedRowRange.IsValid() && ids)
     {
-        const auto rCnt = mRequestedRowRange.Bottom + 1;
-        for (int i = mRequestedRowRange.Top; (i < rCnt); ++i)
+        const auto rCnt = (std::min)(mRequestedRowRange.Bottom + 1, static_cast<int>(ids->GetSize()));
+        std::vector<qlonglong> rowIds;
+        rowIds.reserve(static_cast<size_t>(qMax(0, rCnt - mRequestedRowRange.Top)));
+        for (int i = mRequestedRowRange.Top; i < rCnt; ++i)
+        {
+            rowIds.push_back(ids->GetIdAt(static_cast<size_t>(i)));
+        }
+
+        /// Строки текущего окна переиспользуем по id: после инкрементального
+        /// обновления IdsInfo они могут оказаться на других позициях.
+        const auto& oldValues = mViewWindowValues;
+        std::unordered_map<qlonglong, int> oldRows;
+        for (int i = 0; i < oldValues.Data.size(); ++i)
         {
-            const QVariantList* oldRowPtr = nullptr;
+            oldRows.emplace(oldValues.Data[i].value(mIdColumn).toLongLong(), i);
+        }
+
+        /// После повторной выборки строка окна с прежним _rev не перечитывается.
+        /// Строки из кэша строк окна актуальны и без проверки _rev.
+        std::unordered_map<qlonglong, qlonglong> revisions;
+        if (aRefreshAll && !mViewWindowRevisions.empty())
+        {
+            std::vector<qlonglong> windowIds;
+            for (const auto id : rowIds)
+            {
+                if (oldRows.count(id) && !aRefreshedIds.count(id) && !mRowCachePositions.count(id))
+                {
+                    windowIds.push_back(id);
+                }
+            }
+            try { revisions = GetItemsRevisions(windowIds); }
+            catch (std::runtime_error&)
+            {
+                mSqlCacheTracer.Warning(QString("%1: %2").arg(Q_FUNC_INFO).arg(mTable.GetLastError()));
+                revisions.clear();
+            }
+        }
+        auto isReused = [&](qlonglong aId)
+        {
+            if (aRefreshedIds.count(aId) || !oldRows.count(aId))
+            {
+                return false;
+            }
             if (!aRefreshAll)
             {
-                oldRowPtr = mViewWindowValues.GetRow(i);
+                return true;
             }
+            const auto revision = revisions.find(aId);
+            const auto oldRevision = mViewWindowRevisions.find(aId);
+            return revision != revisions.cend()
+                && oldRevision != mViewWindowRevisions.cend()
+                && revision->second == oldRevision->second;
+        };
+        auto getOldStamp = [&](int aIndex)
+        {
+            return aIndex < oldValues.Stamps.size() ? oldValues.Stamps[aIndex] : 0;
+        };
 
-            if (oldRowPtr)
+        /// Строки, которых нет в текущем окне, загружаем одним набором запросов,
+        /// а не отдельным запросом на каждую строку.
+        std::vector<qlonglong> missingIds;
+        for (const auto id : rowIds)
+        {
+            if (!isReused(id))
+            {
+                missingIds.push_back(id);
+            }
+        }
+        /// Пока читается выборка, окно строится по предыдущей версии IdsInfo, а основная таблица
+        /// уже содержит изменения. Измененные и удаленные строки показываются с прежними значениями,
+        /// если они известны, иначе - пустыми строками до окончания выборки.
+        const bool isSelectionPending = mPendingSelection.has_value();
+        std::unordered_map<qlonglong, QVariantList> previousRows;
+        /// Строки, которых нет в кэше строк окна
+        std::vector<qlonglong> notCachedIds;
+        std::unordered_map<qlonglong, QVariantList> cachedRows;
+        for (const auto id : missingIds)
+        {
+            if (isSelectionPending
+                && (mBatchChanges.ChangedIds.count(id) || mBatchChanges.DeletedIds.count(id)))
+            {
+                auto oldRowIt = mBatchChanges.OldRows.find(id);
+                previousRows.emplace(
+                    id,
+                    oldRowIt != mBatchChanges.OldRows.cend() ? oldRowIt->second : MakePlaceholderRow(id));
+            }
+            else if (const auto* row = GetCachedRow(id))
             {
-                newValues.Data.push_back(*oldRowPtr);
+                cachedRows.emplace(id, *row);
             }
             else
             {
-                auto rowData = GetRecord(i);
-                if (rowData.isEmpty())
+                notCachedIds.push_back(id);
+            }
+        }
+
+        std::unordered_map<qlonglong, qlonglong> newRevisions;
+        QElapsedTimer fetchTimer;
+        fetchTimer.start();
+        auto loadedRows = GetItemsValues(notCachedIds, &newRevisions);
+        if (!notCachedIds.empty())
+        {
+            const auto costUs = fetchTimer.nsecsElapsed() / 1000 / static_cast<qint64>(notCachedIds.size());
+            mRowFetchCostUs = mRowFetchCostUs > 0 ? (mRowFetchCostUs + costUs) / 2 : costUs;
+        }
+        for (const auto& [id, row] : loadedRows)
+        {
+            CacheRow(id, row);
+        }
+        loadedRows.merge(cachedRows);
+
+        newValues.Data.reserve(qMax(0, rCnt - mRequestedRowRange.Top));
+        newValues.Stamps.reserve(qMax(0, rCnt - mRequestedRowRange.Top));
+        for (const auto id : rowIds)
+        {
+            auto oldIt = oldRows.find(id);
+            if (isReused(id))
+            {
+                const auto oldRevision = mViewWindowRevisions.find(id);
+                if (oldRevision != mViewWindowRevisions.cend())
+                {
+                    newRevisions[id] = oldRevision->second;
+                }
+                GetCachedRow(id);
+                const auto stamp = getOldStamp(oldIt->second);
+                newValues.Data.push_back(oldValues.Data[oldIt->second]);
+                newValues.Stamps.push_back(stamp > 0 ? stamp : ++mRowStampCounter);
+                continue;
+            }
+
+            auto it = loadedRows.find(id);
+            if (it == loadedRows.cend())
+            {
+                it = previousRows.find(id);
+                if (it == previousRows.cend())
                 {
-                    break;
+                    /// Строка удалена в обход отслеживаемых действий. Окно не обрезается,
+                    /// чтобы строки после нее остались на своих позициях.
+                    it = previousRows.emplace(id, MakePlaceholderRow(id)).first;
                 }
-                Q_ASSERT(rowData.count() == mTable.GetColumnCount());
-                newValues.Data.push_back(SqlQueryUtils::Record2Fields(rowData));
             }
+            Q_ASSERT(it->second.size() == mTable.GetColumnCount());
+            /// Перечитанная строка с прежними значениями сохраняет метку
+            const bool isUnchanged = oldIt != oldRows.cend()
+                && getOldStamp(oldIt->second) > 0
+                && oldValues.Data[oldIt->second] == it->second;
+            newValues.Data.push_back(it->second);
+            newValues.Stamps.push_back(isUnchanged ? getOldStamp(oldIt->second) : ++mRowStampCounter);
         }
+
+        mViewWindowRevisions = std::move(newRevisions);
+    }
+    else
+    {
+        mViewWindowRevisions.clear();
     }
 
     if (!newValues.Data.empty())
@@ -447,51 +722,118 @@ void SyncSqlCache::UpdateViewWindowValuesInternal(bool aRefreshAll)
         .arg(ToString(newValues.Rows))
         .arg(ToString(newValues.RowsVisible)));
 
-    mViewWindowValues.SetData(newValues.Data, newValues.Rows, newValues.RowsVisible, GetRecordsCount());
+    mViewWindowValues.SetData(
+        newValues.Data,
+        newValues.Stamps,
+        newValues.Rows,
+        newValues.RowsVisible,
+        GetRecordsCount());
+    mViewWindowValues.RowFetchCostUs = mRowFetchCostUs;
+    mViewWindowValues.RowsRevision = mRowsRevision;
 }
 
-void SyncSqlCache::UpdateExtraData()
+const QVariantList* SyncSqlCache::GetCachedRow(qlonglong aId)
 {
-    if (!mOperationHandler)
+    auto it = mRowCachePositions.find(aId);
+    if (it == mRowCachePositions.end())
+    {
+        return nullptr;
+    }
+    mRowCache.splice(mRowCache.begin(), mRowCache, it->second);
+    return &it->second->second;
+}
+
+void SyncSqlCache::CacheRow(qlonglong aId, const QVariantList& aRow)
+{
+    auto it = mRowCachePositions.find(aId);
+    if (it != mRowCachePositions.end())
     {
+        it->second->second = aRow;
+        mRowCache.splice(mRowCache.begin(), mRowCache, it->second);
         return;
     }
-    mOperationHandler->MakeExtraData(mViewWindowValues);
+
+    mRowCache.emplace_front(aId, aRow);
+    mRowCachePositions.emplace(aId, mRowCache.begin());
+    if (mRowCache.size() > RowCacheSize)
+    {
+        mRowCachePositions.erase(mRowCache.back().first);
+        mRowCache.pop_back();
+    }
 }
 
-void SyncSqlCache::UpdateIdMapping(QSqlQuery& aQuery)
+void SyncSqlCache::EraseCachedRow(qlonglong aId)
 {
-    auto [it, emplaced] = mVersionedIds.try_emplace(mViewWindowValues.Version, IdsInfo {});
-    if (!emplaced)
+    auto it = mRowCachePositions.find(aId);
+    if (it == mRowCachePositions.end())
     {
-        mSqlCacheTracer.Warning("UpdateIdMapping: version already exists");
         return;
     }
+    mRowCache.erase(it->second);
+    mRowCachePositions.erase(it);
+}
 
-    auto& ids = it->second;
+void SyncSqlCache::EvictChangedRow(qlonglong aId)
+{
+    auto it = mRowCachePositions.find(aId);
+    if (it == mRowCachePositions.end())
+    {
+        return;
+    }
+    mBatchChanges.OldRows.emplace(aId, std::move(it->second->second));
+    mRowCache.erase(it->second);
+    mRowCachePositions.erase(it);
+}
 
-    if (it != mVersionedIds.begin())
+QVariantList SyncSqlCache::MakePlaceholderRow(qlonglong aId) const
+{
+    QVariantList row;
+    const auto columnCount = static_cast<int>(mTable.GetColumnCount());
+    row.reserve(columnCount);
+    for (int i = 0; i < columnCount; ++i)
     {
-        auto previousIt = it;
-        --previousIt;
+        row.append(QVariant {});
+    }
+    row[mIdColumn] = aId;
+    return row;
+}
 
-        ids.Ids.reserve(previousIt->second.Ids.size());
+void SyncSqlCache::ClearRowCache()
+{
+    mRowCache.clear();
+    mRowCachePositions.clear();
+}
+
+void SyncSqlCache::UpdateExtraData()
+{
+    if (!mOperationHandler)
+    {
+        return;
     }
-    while (aQuery.next())
+    mOperationHandler->MakeExtraData(mViewWindowValues);
+}
+
+void SyncSqlCache::UpdateIdMapping(IdsInfo&& aIds)
+{
+    auto [it, emplaced] = mVersionedIds.try_emplace(mViewWindowValues.Version, std::move(aIds));
+    if (!emplaced)
     {
-        ids.AddId(aQuery.value(0));
+        mSqlCacheTracer.Warning("UpdateIdMapping: version already exists");
     }
 }
 
-void SyncSqlCache::ProcessDataPopulation(QSqlQuery& aQuery)
+void SyncSqlCache::ProcessDataPopulation(
+    IdsInfo&& aIds,
+    bool aRefreshAll,
+    const std::unordered_set<qlonglong>& aRefreshedIds)
 {
     ++mViewWindowValues.Version;
 
-    UpdateIdMapping(aQuery);
+    UpdateIdMapping(std::move(aIds));
 
     TransformSelection(mViewWindowValues.Version - 1, mViewWindowValues.Selection, mViewWindowValues.CurrentRow);
     UpdateRowWindow();
-    UpdateViewWindowValues(true);
+    UpdateViewWindowValues(aRefreshAll, aRefreshedIds);
     if (mOperationHandler)
     {
         mOperationHandler->ProcessDataSelected();
@@ -521,7 +863,12 @@ std::optional<SyncSqlCache::RowTransformator> SyncSqlCache::GetRowTransformation
         }
     }
 
-    return RowTransformator { previousIt->second, currentIt->second };
+    RowTransformator transformator;
+    for (auto it = previousIt; it != std::next(currentIt); ++it)
+    {
+        transformator.Versions.push_back(&it->second);
+    }
+    return transformator;
 }
 
 qlonglong SyncSqlCache::GetDbRowCount()
@@ -534,6 +881,31 @@ qlonglong SyncSqlCache::GetDbRowCount()
     }
 }
 
+void SyncSqlCache::VerifyDbRowCount()
+{
+    if (mIsDbRowCountVerified)
+    {
+        return;
+    }
+    mIsDbRowCountVerified = true;
+
+    try
+    {
+        const auto trackedCount = mTable.GetTrackedRowCount();
+        const auto actualCount = mTable.CountRows();
+        if (trackedCount && *trackedCount != actualCount)
+        {
+            mSqlCacheTracer.Warning(QString("%1: tracked row count %2 differs from actual %3, table name: %4")
+                .arg(Q_FUNC_INFO)
+                .arg(*trackedCount)
+                .arg(actualCount)
+                .arg(mTable.GetName()));
+        }
+        mTable.SetRowCount(actualCount);
+    }
+    catch (std::runtime_error&) { ReportError(Q_FUNC_INFO); }
+}
+
 qlonglong SyncSqlCache::GetSuspendDbRowCount()
 {
     try { return mSuspendedItemsTable.GetRowCount(); }
@@ -611,7 +983,12 @@ void SyncSqlCache::UpdateRowWindow()
     auto tranformator = GetRowTransformation(mViewWindowValues.Version - 1);
     if (tranformator && mRequestedRowRange.IsValid() && !mIsAutoScroll)
     {
-        TransformRowRange(*tranformator, mRequestedRowRange, mRequestedRowRangeVisible);
+        TransformRowRange(
+            *tranformator,
+            mRequestedTopMargin,
+            mRequestedBottomMargin,
+            mRequestedRowRange,
+            mRequestedRowRangeVisible);
 
         mSqlCacheTracer.Trace(QString("%1: transf : range: %2, range vis: %3")
             .arg(Q_FUNC_INFO)
@@ -631,7 +1008,7 @@ void SyncSqlCache::UpdateRowWindow()
     }
     if (!mRequestedRowRange.Contains(mRequestedRowRangeVisible, SqlQueryUtils::RowWindowOffset))
     {
-        mRequestedRowRange = mRequestedRowRangeVisible.Expand(SqlQueryUtils::RowWindowOffset);
+        mRequestedRowRange = mRequestedRowRangeVisible.Expand(mRequestedTopMargin, mRequestedBottomMargin);
     }
 
     mSqlCacheTracer.Trace(QString("%1: after  : range: %2, range vis: %3")
@@ -642,6 +1019,8 @@ void SyncSqlCache::UpdateRowWindow()
 
 bool SyncSqlCache::TransformRowRange(
     const SyncSqlCache::RowTransformator& aTransformator,
+    int aTopMargin,
+    int aBottomMargin,
     RowRange& outRange,
     RowRange& outRangeVisible)
 {
@@ -652,7 +1031,7 @@ bool SyncSqlCache::TransformRowRange(
     }
 
     outRangeVisible = RowRange { newVisibleTop, newVisibleTop + outRangeVisible.Distance() };
-    outRange = outRangeVisible.Expand(SqlQueryUtils::RowWindowOffset);
+    outRange = outRangeVisible.Expand(aTopMargin, aBottomMargin);
 
     return true;
 }
@@ -664,30 +1043,54 @@ std::optional<RowRequest> SyncSqlCache::TransformRowRange(const RowRequest& aRow
     if (transformator)
     {
         RowRequest request = aRowRequest;
-        TransformRowRange(*transformator, request.RowWindow, request.RowWindowVisible);
+        TransformRowRange(
+            *transformator,
+            request.TopMargin,
+            request.BottomMargin,
+            request.RowWindow,
+            request.RowWindowVisible);
         return request;
     }
 
     return std::nullopt;
 }
 
+size_t SyncSqlCache::IdsInfo::GetSize() const
+{
+    return Changes ? RowsCount : Ids.size();
+}
+
 QVariant SyncSqlCache::IdsInfo::GetId(int aI) const
 {
     if (IsOutOfRange(aI))
     {
         return {};
     }
-    return Ids.at(static_cast<size_t>(aI));
+    return GetIdAt(static_cast<size_t>(aI));
+}
+
+qlonglong SyncSqlCache::IdsInfo::GetIdAt(size_t aI) const
+{
+    if (Changes)
+    {
+        return SortKeys->Tree.At(aI).Id;
+    }
+    return Ids[aI];
 }
 
 bool SyncSqlCache::IdsInfo::IsOutOfRange(int aI) const
 {
-    return (aI < 0 || static_cast<size_t>(aI) >= Ids.size());
+    return (aI < 0 || static_cast<size_t>(aI) >= GetSize());
 }
 
 std::optional<size_t> SyncSqlCache::IdsInfo::GetRow(const QVariant& aId) const
 {
     auto id = aId.toLongLong();
+    if (Changes)
+    {
+        return SortKeys->GetRow(id);
+    }
+
     auto it = IdPositions.find(id);
     if (it != IdPositions.cend())
     {
@@ -714,6 +1117,41 @@ std::optional<size_t> SyncSqlCache::IdsInfo::GetRow(const QVariant& aId) const
     return std::nullopt;
 }
 
+std::optional<size_t> SyncSqlCache::IdsInfo::TransformFrom(const IdsInfo& aPrevious, size_t aRow) const
+{
+    if (aRow >= aPrevious.GetSize())
+    {
+        return std::nullopt;
+    }
+    if (Changes)
+    {
+        return Changes->Transform(aRow);
+    }
+    /// Предыдущая версия, построенная по индексу, - последняя из его версий,
+    /// так как новая выборка создает новый индекс
+    return GetRow(aPrevious.GetIdAt(aRow));
+}
+
+void SyncSqlCache::IdsInfo::CopyIds(size_t aCount, QVector<qlonglong>& outIds) const
+{
+    aCount = (std::min)(aCount, GetSize());
+    outIds.reserve(outIds.size() + static_cast<int>(aCount));
+    if (!Changes)
+    {
+        std::copy(Ids.cbegin(), Ids.cbegin() + static_cast<std::ptrdiff_t>(aCount), std::back_inserter(outIds));
+        return;
+    }
+
+    SortKeys->Tree.ForEach([&outIds, &aCount](const SortKeyRow& aRow)
+    {
+        if (aCount > 0)
+        {
+            outIds.push_back(aRow.Id);
+            --aCount;
+        }
+    });
+}
+
 void SyncSqlCache::IdsInfo::AddId(const QVariant& aId)
 {
     Ids.push_back(aId.toLongLong());
@@ -724,7 +1162,20 @@ void SyncSqlCache::ClearTable(bool aIsFinal)
     Q_UNUSED(aIsFinal)
 
     mIsSelectionAllowed = false;
+    mIsIdMappingActual = false;
+    mIsDbRowCountVerified = false;
+    mBatchChanges = BatchChanges {};
     mVersionedIds.clear();
+    mSortKeyIndex.reset();
+    mViewWindowRevisions.clear();
+    ClearRowCache();
+    mQueuedHeavyActions.clear();
+    if (mPendingSelection)
+    {
+        mPendingSelection->Query.finish();
+        mPendingSelection.reset();
+        mSelectionInterruption.RunningId.store(0);
+    }
 
     if (mOperationHandler)
     {
@@ -741,7 +1192,6 @@ void SyncSqlCache::ClearTable(bool aIsFinal)
     mRequestedRowRangeVisible = RowRange {};
     mViewWindowValues = ViewWindowValues {};
     mSuspendedDeletedIds.clear();
-    mTableOperationsCounter = 0;
     mSuspendedRecordsCounter = 0;
 
     emit ClearCompleted();
@@ -757,97 +1207,242 @@ bool SyncSqlCache::AddPendingValue(QVariantList& aValues)
         }
     }
 
+    /// Значения скрытых колонок *_folded добавляются в конец строки
+    /// в порядке mCommonFieldsIndexes, как и при создании таблицы.
+    QVariantList foldedValues;
     for (const auto& [commonIndex, indexes] : mCommonFieldsIndexes)
     {
-        aValues[commonIndex] = SqlQueryUtils::GetFullTextSearchValue(aValues, indexes);
+        const auto common = SqlQueryUtils::GetFullTextSearchValue(aValues, indexes);
+        aValues[commonIndex] = common;
+        foldedValues.append(common.toLower());
     }
+    aValues.append(foldedValues);
 
     return true;
 }
 
-void SyncSqlCache::DeleteRecord(qlonglong aId, bool aSuspend)
+void SyncSqlCache::DeleteRecords(const QVariantList& aIds, bool aSuspend)
 {
-    GetTable(aSuspend).PerformAction(SqlCacheTable::Action::Delete, aId);
+    if (!aSuspend)
+    {
+        for (const auto& id : aIds)
+        {
+            EvictChangedRow(id.toLongLong());
+        }
+    }
 
-    if (aSuspend)
+    auto& table = GetTable(aSuspend);
+    for (int i = 0; i < aIds.size(); i += SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER)
     {
-        mSuspendedDeletedIds.insert(aId);
+        table.PerformAction(
+            SqlCacheTable::Action::DeleteList,
+            aIds.mid(i, SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER));
     }
-    else if (mOperationHandler)
+
+    for (const auto& id : aIds)
     {
-        mOperationHandler->DeletePendingValue(aId);
+        if (aSuspend)
+        {
+            mSuspendedDeletedIds.insert(id.toLongLong());
+            continue;
+        }
+
+        mBatchChanges.ChangedIds.erase(id.toLongLong());
+        mBatchChanges.DeletedIds.insert(id.toLongLong());
+        if (mOperationHandler)
+        {
+            mOperationHandler->DeletePendingValue(id);
+        }
     }
 }
 
-void SyncSqlCache::InsertOrReplace(const QVariantList& aFields, bool aSuspend)
+void SyncSqlCache::RememberOldSortKeys(const QVariantList& aRows)
 {
-    auto fields = aFields;
-    /// Не вызываем AddPendingValue в случае Suspend
-    if (aSuspend || AddPendingValue(fields))
+    const auto* ids = GetCurrentIdMapping();
+    if (!mIsIdMappingActual || !mBatchChanges.IsComplete || !ids || mSortKeyIndex)
     {
-        GetTable(aSuspend).PerformAction(SqlCacheTable::Action::Insert, fields);
+        /// При наличии mSortKeyIndex старые ключи берутся из индекса
+        return;
     }
-}
 
-void SyncSqlCache::StoreItemsToDb(
-    const TNewItemsBufferPtr& aValues,
-    bool aSuspend) noexcept(false)
-{
-    for (const auto& item : *aValues)
+    /// Ключ нужен только при первом изменении строки, которая есть в выборке
+    std::vector<qlonglong> selectedIds;
+    for (const auto& row : aRows)
     {
-        if (item.size() > 1)
-        {
-            InsertOrReplace(item, aSuspend);
-        }
-        else
+        const auto id = row.toList().value(mIdColumn).toLongLong();
+        if (ids->GetRow(id)
+            && !mBatchChanges.OldKeys.count(id)
+            && !mBatchChanges.ChangedIds.count(id)
+            && !mBatchChanges.DeletedIds.count(id))
         {
-            DeleteRecord(item.at(0).toLongLong(), aSuspend);
+            selectedIds.push_back(id);
         }
     }
-                
-    auto& counter = aSuspend ? mSuspendedRecordsCounter : mTableOperationsCounter;
-    counter += aValues->size();
+    if (selectedIds.empty())
+    {
+        return;
+    }
+
+    for (auto& row : GetSortKeys(selectedIds, GetSortColumns(), false))
+    {
+        mBatchChanges.OldKeys.emplace(row.Id, std::move(row.Key));
+    }
 }
 
-void SyncSqlCache::ResumeSuspendedItems() noexcept(false)
+void SyncSqlCache::InsertOrReplace(const QVariantList& aRows, bool aSuspend)
 {
-    size_t i = 0;
-    int progress = 0;
-    auto updateProgress = [&]()
+    if (!aSuspend)
     {
-        if (i >= mSuspendedRecordsCounter)
+        try
         {
-            return;
+            RememberOldSortKeys(aRows);
         }
-        auto v = static_cast<int>((++i) * 100 / mSuspendedRecordsCounter);
-        if (v != progress)
+        catch (const std::runtime_error& ex)
         {
-            progress = v;
-            emit PendingUpdatesProgressChanged(progress);
+            /// Без старых ключей изменения применяются полной выборкой
+            mBatchChanges.IsComplete = false;
+            mSqlCacheTracer.Warning(QString("%1: %2").arg(Q_FUNC_INFO).arg(ex.what()));
         }
-    };
-
-    mSuspendedRecordsCounter = GetSuspendDbRowCount() + mSuspendedDeletedIds.size();
+    }
 
-    /// Удаляем
-    for (const auto& id : mSuspendedDeletedIds)
+    if (!aSuspend)
     {
-        DeleteRecord(id, false);
-        updateProgress();
+        for (const auto& row : aRows)
+        {
+            EvictChangedRow(row.toList().value(mIdColumn).toLongLong());
+        }
+    }
+
+    auto& table = GetTable(aSuspend);
+    const auto maxRowsCount = table.GetMaxInsertRowsCount();
+    for (int i = 0; i < aRows.size(); i += maxRowsCount)
+    {
+        table.PerformAction(SqlCacheTable::Action::InsertList, aRows.mid(i, maxRowsCount));
+    }
+
+    if (!aSuspend)
+    {
+        for (const auto& row : aRows)
+        {
+            const auto id = row.toList().value(mIdColumn).toLongLong();
+            mBatchChanges.DeletedIds.erase(id);
+            mBatchChanges.ChangedIds.insert(id);
+        }
+    }
+}
+
+void SyncSqlCache::StoreItemsToDb(
+    const TNewItemsBufferPtr& aValues,
+    bool aSuspend) noexcept(false)
+{
+    /// Подряд идущие вставки и удаления объединяем в групповые запросы.
+    /// Порядок применения изменений между группами сохраняется.
+    QVariantList insertedRows;
+    QVariantList deletedIds;
+
+    auto flushInsertedRows = [&]()
+    {
+        if (!insertedRows.empty())
+        {
+            InsertOrReplace(insertedRows, aSuspend);
+            insertedRows.clear();
+        }
+    };
+    auto flushDeletedIds = [&]()
+    {
+        if (!deletedIds.empty())
+        {
+            DeleteRecords(deletedIds, aSuspend);
+            deletedIds.clear();
+        }
+    };
+
+    for (const auto& item : *aValues)
+    {
+        if (item.size() > 1)
+        {
+            flushDeletedIds();
+
+            auto fields = item;
+            /// Не вызываем AddPendingValue в случае Suspend
+            if (aSuspend || AddPendingValue(fields))
+            {
+                insertedRows.push_back(fields);
+            }
+        }
+        else
+        {
+            flushInsertedRows();
+            deletedIds.push_back(item.at(0).toLongLong());
+        }
+    }
+    flushInsertedRows();
+    flushDeletedIds();
+                
+    if (aSuspend)
+    {
+        mSuspendedRecordsCounter += aValues->size();
+    }
+}
+
+void SyncSqlCache::ResumeSuspendedItems() noexcept(false)
+{
+    size_t i = 0;
+    int progress = 0;
+    auto updateProgress = [&]()
+    {
+        if (i >= mSuspendedRecordsCounter)
+        {
+            return;
+        }
+        auto v = static_cast<int>((++i) * 100 / mSuspendedRecordsCounter);
+        if (v != progress)
+        {
+            progress = v;
+            emit PendingUpdatesProgressChanged(progress);
+        }
+    };
+
+    mSuspendedRecordsCounter = GetSuspendDbRowCount() + mSuspendedDeletedIds.size();
+
+    /// Удаляем
+    QVariantList deletedIds;
+    for (const auto& id : mSuspendedDeletedIds)
+    {
+        deletedIds.push_back(id);
+    }
+    DeleteRecords(deletedIds, false);
+    for (int j = 0; j < deletedIds.size(); ++j)
+    {
+        updateProgress();
     }
     mSuspendedDeletedIds.clear();
 
     /// Перекачиваем данные из одной таблицы в другую
-    auto sql = QString("SELECT * FROM %1 ORDER BY id")
+    auto sql = QString("SELECT %1 FROM %2 ORDER BY id")
+        .arg(SqlQueryUtils::FieldsPlaceholder)
         .arg(SqlQueryUtils::TablePlaceholder);
     mSuspendedItemsTable.PerformSql(sql, {}, {}, true);
 
+    const auto maxRowsCount = mTable.GetMaxInsertRowsCount();
+    QVariantList rows;
     auto& query = mSuspendedItemsTable.GetLastQuery();
     while (query.next())
     {
-        InsertOrReplace(Record2List(query.record()), false);
+        auto fields = Record2List(query.record());
+        if (AddPendingValue(fields))
+        {
+            rows.push_back(fields);
+        }
+        if (rows.size() >= maxRowsCount)
+        {
+            InsertOrReplace(rows, false);
+            rows.clear();
+        }
         updateProgress();
     }
+    InsertOrReplace(rows, false);
+
     /// Очищаем временную таблицу
     mSuspendedItemsTable.PerformAction(SqlCacheTable::Action::Clear);
     mSuspendedRecordsCounter = 0;
@@ -858,6 +1453,8 @@ std::optional<std::pair<qint64, qint64>> SyncSqlCache::TryStoreItemsToDb(
     const TNewItemsBufferPtr& aValues,
     bool aSuspend) noexcept
 {
+    mBatchChanges = BatchChanges {};
+
     if (aValues->empty() && (aSuspend || !mSuspendedRecordsCounter))
     {
         /// Ничего не пришло и нечего применять из приостановленных записей
@@ -882,6 +1479,10 @@ std::optional<std::pair<qint64, qint64>> SyncSqlCache::TryStoreItemsToDb(
             && mOperationHandler
             && mOperationHandler->IsInsertionNeeded())
         {
+            /// Плагин может изменить любые строки
+            mBatchChanges.IsComplete = false;
+            mViewWindowRevisions.clear();
+            ClearRowCache();
             mOperationHandler->ProcessDataInserted();
         }
 
@@ -891,6 +1492,10 @@ std::optional<std::pair<qint64, qint64>> SyncSqlCache::TryStoreItemsToDb(
     {
         ReportError(Q_FUNC_INFO);
         mDbConnection.GetDatabase().rollback();
+        /// Отслеживаемое количество строк учитывает откаченные изменения
+        mTable.InvalidateRowCount();
+        mSuspendedItemsTable.InvalidateRowCount();
+        mBatchChanges.IsComplete = false;
     }
     const auto d3 = QDateTime::currentDateTime().toMSecsSinceEpoch();
 
@@ -906,18 +1511,14 @@ std::pair<std::optional<int>, std::optional<int>> SyncSqlCache::EstimateDbRowCou
     if (aMainTableUpdated)
     {
         /// Обновляем количество строк только если пришли новые данные.
+        /// Количество отслеживается при вставке и удалении, полный подсчёт
+        /// выполняется только если оно неизвестно.
+        auto d4 = QDateTime::currentDateTime().toMSecsSinceEpoch();
+        dbRecordCount = static_cast<int>(GetDbRowCount());
         if (mIsSelectionAllowed)
         {
-            auto d4 = QDateTime::currentDateTime().toMSecsSinceEpoch();
-            dbRecordCount = GetDbRowCount();
             rowCountingDuration = static_cast<int>(QDateTime::currentDateTime().toMSecsSinceEpoch() - d4);
         }
-        else
-        {
-            /// Пока крутятся шарики приблизительно считаем количество добавленных записей,
-            /// т.к. проверка размера таблицы - тяжелая операция.
-            dbRecordCount = mTableOperationsCounter;
-        }
     }
     return std::make_pair(dbRecordCount, rowCountingDuration);
 }
@@ -929,6 +1530,11 @@ std::optional<int> SyncSqlCache::TryPerformSelection(
 {
     if (!mIsSelectionAllowed)
     {
+        if (aMainTableUpdated)
+        {
+            /// Таблица изменилась без выборки
+            mIsIdMappingActual = false;
+        }
         return std::nullopt;
     }
     
@@ -937,7 +1543,22 @@ std::optional<int> SyncSqlCache::TryPerformSelection(
         || aFilter)
     {
         const auto d = QDateTime::currentDateTime().toMSecsSinceEpoch();
-        PerformSelection();
+
+        bool isApplied = false;
+        if (!aSorting && !aFilter)
+        {
+            try { isApplied = TryApplyBatchChanges(); }
+            catch (std::runtime_error&)
+            {
+                mSqlCacheTracer.Warning(QString("%1: %2").arg(Q_FUNC_INFO).arg(mTable.GetLastError()));
+            }
+        }
+        if (!isApplied && !PerformSelection())
+        {
+            /// Выборка прервана более новым запросом
+            return std::nullopt;
+        }
+        /// Если id выборки еще читаются, длительность пересчитывается при завершении
         return static_cast<int>(QDateTime::currentDateTime().toMSecsSinceEpoch() - d);
     }
     else
@@ -986,6 +1607,24 @@ void SyncSqlCache::ProcessHeavyAction(
     bool aReportSelected,
     bool aSuspendUpdates)
 {
+    if (mPendingSelection)
+    {
+        /// Запрос отправлен в конвейере до ответа на предыдущий. Он выполняется после чтения выборки,
+        /// чтобы ответы шли в порядке запросов и новые данные не вставлялись при открытом курсоре выборки.
+        /// Вставка с перезапуском выборки не используется: при непрерывном потоке данных
+        /// выборка перезапускалась бы на каждом буфере и не публиковала бы новую версию.
+        /// Между порциями выборки по-прежнему выполняются EasyAction.
+        mQueuedHeavyActions.push_back(QueuedHeavyAction {
+            aRequestId,
+            aValues,
+            aLoadingStatus,
+            aSorting,
+            aFilter,
+            aReportSelected,
+            aSuspendUpdates });
+        return;
+    }
+
     auto selectedRows = aReportSelected ? std::get<0>(GetSelectedIds()) : TSelectedIds {};
     SetSorting(aSorting);
     SetFilter(aFilter);
@@ -1002,29 +1641,57 @@ void SyncSqlCache::ProcessHeavyAction(
     const bool mainTableUpdatedOrLoadFinished = mainTableUpdated
         || aLoadingStatus == LoadingStatus::Finished;
     
-    const auto selectionDuration = TryPerformSelection(
+    HeavyActionResult result;
+    result.RequestId = aRequestId;
+    result.SelectedRows = std::move(selectedRows);
+    result.InsertionDuration = insertionDuration;
+    result.MainTableUpdatedOrLoadFinished = mainTableUpdatedOrLoadFinished;
+    result.IsSuspend = isSuspend;
+    result.Status = aLoadingStatus;
+    result.ValuesCount = aValues->size();
+    result.SelectionDuration = TryPerformSelection(
         mainTableUpdatedOrLoadFinished,
         aSorting,
         aFilter);
-    
+
+    if (mPendingSelection)
+    {
+        /// Ответ будет отправлен после чтения всех id выборки
+        mPendingSelection->HeavyAction = std::move(result);
+        return;
+    }
+    CompleteHeavyAction(result);
+}
+
+void SyncSqlCache::CompleteHeavyAction(const HeavyActionResult& aResult)
+{
+    mViewWindowValues.RequestId = aResult.RequestId;
+
+    if (aResult.Status == LoadingStatus::Finished)
+    {
+        VerifyDbRowCount();
+    }
+
     auto [dbRecordCount, rowCountingDuration] = EstimateDbRowCount(
-        mainTableUpdatedOrLoadFinished,
-        isSuspend);
+        aResult.MainTableUpdatedOrLoadFinished,
+        aResult.IsSuspend);
 
     LogHeavyAction(
-        insertionDuration,
-        selectionDuration,
+        aResult.InsertionDuration,
+        aResult.SelectionDuration,
         dbRecordCount,
         rowCountingDuration,
-        aValues->size());
+        aResult.ValuesCount);
 
     emit OperationCompleted(
-        selectionDuration ? QVariant {*selectionDuration} : QVariant {},
+        aResult.SelectionDuration ? QVariant {*aResult.SelectionDuration} : QVariant {},
         dbRecordCount ? QVariant {*dbRecordCount} : QVariant {},
         static_cast<qulonglong>(mSuspendedRecordsCounter),
         mViewWindowValues,
-        selectionDuration.has_value(),
-        selectedRows);
+        aResult.SelectionDuration.has_value(),
+        aResult.SelectedRows);
+
+    ScheduleSortIndexesMaintenance();
 }
 
 void SyncSqlCache::ProcessEasyAction(
@@ -1058,7 +1725,7 @@ void SyncSqlCache::ProcessEasyAction(
                     aBottomIsEnd);
 
             rowRequest.RowWindowVisible = newVisibleRange;
-            rowRequest.RowWindow = newVisibleRange.Expand(SqlQueryUtils::RowWindowOffset);
+            rowRequest.RowWindow = newVisibleRange.Expand(aRowRequest.TopMargin, aRowRequest.BottomMargin);
         };
 
         if (aHintsRequest.ScrollHint == ScrollHintType::EnsureVisible)
@@ -1083,6 +1750,8 @@ void SyncSqlCache::ProcessEasyAction(
     }
 
     emit OperationCompleted(QVariant(), QVariant(), QVariant(), mViewWindowValues, isUpdated, std::nullopt);
+
+    ScheduleSortIndexesMaintenance();
 }
 
 bool SyncSqlCache::SetRowWindow(const RowRequest& aRowRequest)
@@ -1104,6 +1773,9 @@ bool SyncSqlCache::SetRowWindow(const RowRequest& aRowRequest)
             .arg(ToString(rowRequestUpdated.RowWindowVisible)));
     }
 
+    mRequestedTopMargin = rowRequestUpdated.TopMargin;
+    mRequestedBottomMargin = rowRequestUpdated.BottomMargin;
+
     if ((mRequestedRowRange != rowRequestUpdated.RowWindow)
         || (mRequestedRowRangeVisible != rowRequestUpdated.RowWindowVisible))
     {
@@ -1136,6 +1808,18 @@ bool SyncSqlCache::SetSelection(const SelectionRequest& aSelectionRequest)
     return false;
 }
 
+QStringList SyncSqlCache::MakeFoldedFields(
+    const SqlFieldDescription* aFieldList,
+    const TCommonIndexesRanges& aCommonFieldsIndexes)
+{
+    QStringList fields;
+    for (const auto& commonFieldIndexes : aCommonFieldsIndexes)
+    {
+        fields << QString(aFieldList[commonFieldIndexes.first].mName) + SqlQueryUtils::FoldedColumnSuffix;
+    }
+    return fields;
+}
+
 void SyncSqlCache::ConfirmVersion(qint64 aVersion)
 {
     auto itEnd = mVersionedIds.lower_bound(aVersion);
@@ -1145,197 +1829,1119 @@ void SyncSqlCache::ConfirmVersion(qint64 aVersion)
     }
 }
 
-void SyncSqlCache::PerformSelection()
+bool SyncSqlCache::PerformSelection()
 {
     auto d1 = QDateTime::currentDateTime().toMSecsSinceEpoch();
 
-    auto sql = QString("SELECT id FROM %1 WHERE %2 %3")
+    const auto sortColumns = GetSortColumns();
+    QStringList columns { "id" };
+    if (mUseOrderIndex)
+    {
+        for (const auto& sortColumn : sortColumns)
+        {
+            columns << mTable.GetColumnName(sortColumn.Column);
+        }
+    }
+
+    auto sql = QString("SELECT %1 FROM %2 WHERE %3 %4")
+        .arg(columns.join(","))
         .arg(SqlQueryUtils::TablePlaceholder)
         .arg(SqlQueryUtils::FilterPlaceholder)
         .arg(OrderByClause());
-    try { mTable.PerformSql(sql, {}, mFilter, true); }
-    catch(std::runtime_error&) { ReportError(Q_FUNC_INFO); }
+    const auto filter = GetSelectionFilter();
+    bool isSelected = true;
+    mSelectionInterruption.RunningId.store(mViewWindowValues.RequestId);
+    const bool isInterruptible = SetSelectionInterruptible(true);
+    try { mTable.PerformSql(sql, {}, filter, true); }
+    catch(std::runtime_error&)
+    {
+        if (IsSelectionInterrupted())
+        {
+            isSelected = false;
+        }
+        else if (filter == mFilter)
+        {
+            ReportError(Q_FUNC_INFO);
+            isSelected = false;
+        }
+        else
+        {
+            /// Полнотекстовый индекс - только оптимизация, повторяем запрос с исходным фильтром.
+            /// Индекс удаляется, только если без него запрос выполнился: иначе ошибка
+            /// не связана с переписанным фильтром (блокировка, ошибка в самом фильтре).
+            const auto fullTextError = mTable.GetLastError();
+            try
+            {
+                mTable.PerformSql(sql, {}, mFilter, true);
+                mSqlCacheTracer.Warning(QString("%1: full-text index disabled: %2")
+                    .arg(Q_FUNC_INFO)
+                    .arg(fullTextError));
+                /// Повторное включение через SetFullTextIndexAsync(true) создаст индекс заново
+                mUseFullTextIndex = false;
+            }
+            catch(std::runtime_error&)
+            {
+                if (!IsSelectionInterrupted())
+                {
+                    mSqlCacheTracer.Warning(QString("%1: full-text filter failed: %2")
+                        .arg(Q_FUNC_INFO)
+                        .arg(fullTextError));
+                    ReportError(Q_FUNC_INFO);
+                }
+                isSelected = false;
+            }
+        }
+    }
+    if (isInterruptible)
+    {
+        SetSelectionInterruptible(false);
+    }
 
-    auto d2 = QDateTime::currentDateTime().toMSecsSinceEpoch();
+    PendingSelection selection;
+    selection.Query = mTable.GetLastQuery();
+    selection.Sql = sql;
+    selection.SortColumns = sortColumns;
+    selection.IsSelected = isSelected;
+    selection.HasSortKeys = mUseOrderIndex && isSelected;
+    selection.StartTime = d1;
+    selection.QueryDuration = QDateTime::currentDateTime().toMSecsSinceEpoch() - d1;
+    if (const auto* currentIds = GetCurrentIdMapping())
+    {
+        selection.Ids.Ids.reserve(currentIds->GetSize());
+        if (selection.HasSortKeys)
+        {
+            selection.SortKeyRows.reserve(currentIds->GetSize());
+        }
+    }
+    mPendingSelection = std::move(selection);
 
-    ProcessDataPopulation(mTable.GetLastQuery());
+    if (!isSelected || ReadSelectionSlice())
+    {
+        return FinishSelection();
+    }
 
-    mSqlCacheTracer.Trace("PerformSelection: " + sql);
-    mSqlCacheTracer.Trace(QString("%1: selection: %2 ms, processing: %3 ms")
-        .arg(Q_FUNC_INFO)
-        .arg(d2 - d1)
-        .arg(QDateTime::currentDateTime().toMSecsSinceEpoch() - d2));
+    /// Остальные id читаются частями, между которыми выполняются EasyAction
+    /// по предыдущей версии IdsInfo
+    ScheduleSelectionSlice();
+    return true;
 }
 
-void SyncSqlCache::SetSorting(const TSortParametersArg& aSorting)
+bool SyncSqlCache::ReadSelectionSlice()
 {
-    if (!aSorting)
+    auto& selection = *mPendingSelection;
+    auto& query = selection.Query;
+    const SortKeyLess less { this, selection.SortColumns };
+    const auto sortColumnsCount = static_cast<int>(selection.SortColumns.size());
+
+    QElapsedTimer timer;
+    timer.start();
+    const bool isInterruptible = SetSelectionInterruptible(true);
+    bool isFinished = false;
+    for (size_t i = 1; ; ++i)
     {
-        return;
-    }
+        if (!query.next())
+        {
+            /// next() возвращает false и при ошибке шага, в том числе при прерывании
+            if (query.lastError().isValid())
+            {
+                selection.Error = query.lastError().text();
+            }
+            isFinished = true;
+            break;
+        }
 
-    mSortColumn = aSorting->Column;
-    mSortOrder = static_cast<Qt::SortOrder>(aSorting->Order);
+        const auto id = query.value(0).toLongLong();
+        selection.Ids.AddId(id);
+        if (selection.HasSortKeys && selection.IsOrdered)
+        {
+            SortKeyRow row { id, {} };
+            for (int column = 1; column <= sortColumnsCount; ++column)
+            {
+                row.Key << query.value(column);
+            }
 
-    mSqlCacheTracer.Info(QString("%1: mSortColumn: %2, mSortOrder: %3")
-        .arg(Q_FUNC_INFO)
-        .arg(mSortColumn)
-        .arg((mSortOrder == Qt::AscendingOrder) ? QString("asc") : QString("desc")));
-}
+            /// Дерево использует сравнение в C++, поэтому проверяем, что оно совпадает с ORDER BY
+            selection.IsOrdered = selection.SortKeyRows.empty() || less(selection.SortKeyRows.back(), row);
+            if (selection.IsOrdered)
+            {
+                selection.SortKeyRows.push_back(std::move(row));
+            }
+        }
 
-void SyncSqlCache::SetFilter(const TFilterParametersArg& aFilter)
-{
-    if (!aFilter)
+        if (i % SelectionSliceCheckRows == 0 && timer.elapsed() >= SelectionSliceMs)
+        {
+            break;
+        }
+    }
+    if (isInterruptible)
     {
-        return;
+        SetSelectionInterruptible(false);
     }
-
-    mFilter = *aFilter;
-    mSqlCacheTracer.Info(QString("%1: %2").arg(Q_FUNC_INFO).arg(mFilter));
+    return isFinished;
 }
 
-void SyncSqlCache::On_PerformSelect(QString aSql, QVariantList aParams)
+void SyncSqlCache::ScheduleSelectionSlice()
 {
-    auto query = PerformSqlSafe(aSql, aParams);
+    QMetaObject::invokeMethod(this, [this]() { ContinueSelection(); }, Qt::QueuedConnection);
+}
 
-    if (!query.isSelect())
+void SyncSqlCache::ContinueSelection()
+{
+    if (!mPendingSelection)
     {
-        static constexpr char error[] = "On_PerformSelect: only select statements allowed here";
-        mSqlCacheTracer.Error(error);
-        emit ErrorOccured(error);
+        /// Выборка отменена очисткой таблицы или дочитана следующим HeavyAction
         return;
     }
 
-    QVariantList result;
-    while (query.next())
+    if (!IsSelectionInterrupted() && !ReadSelectionSlice())
     {
-        result.push_back(Record2List(query.record()));
+        ScheduleSelectionSlice();
+        return;
     }
 
-    emit UserQueryPerformed(result);
+    CompletePendingSelection();
 }
 
-QVariantList SyncSqlCache::Record2List(const QSqlRecord& aRecord)
+void SyncSqlCache::CompletePendingSelection()
 {
-    QVariantList row;
-    for (int i = 0; i < aRecord.count(); ++i)
+    auto heavyAction = std::move(mPendingSelection->HeavyAction);
+    const auto startTime = mPendingSelection->StartTime;
+    const bool isSelected = FinishSelection();
+    if (heavyAction)
     {
-        row.push_back(aRecord.value(i));
+        heavyAction->SelectionDuration = isSelected
+            ? std::optional<int> { static_cast<int>(QDateTime::currentDateTime().toMSecsSinceEpoch() - startTime) }
+            : std::nullopt;
+        CompleteHeavyAction(*heavyAction);
     }
-    return row;
+
+    ProcessQueuedHeavyActions();
 }
 
-void SyncSqlCache::SetUpdatesFromDbAllowed(LoadingStatus aLoadingStatus)
+void SyncSqlCache::ProcessQueuedHeavyActions()
 {
-    if (aLoadingStatus == LoadingStatus::NotChanged)
+    /// Следующий HeavyAction может снова начать выборку частями
+    while (!mPendingSelection && !mQueuedHeavyActions.empty())
     {
-        return;
+        const auto action = std::move(mQueuedHeavyActions.front());
+        mQueuedHeavyActions.pop_front();
+        ProcessHeavyAction(
+            action.RequestId,
+            action.Values,
+            action.Status,
+            action.Sorting,
+            action.Filter,
+            action.ReportSelected,
+            action.SuspendUpdates);
     }
-    
-    mIsSelectionAllowed = (aLoadingStatus == LoadingStatus::Finished);
 }
 
-void SyncSqlCache::OnExport(const QString &aExportFileName, const ColumnsExportInfo &aColumns)
+bool SyncSqlCache::FinishSelection()
 {
-    CsvExporter exp(aExportFileName);
-    if(!exp.IsReadyForWrite())
+    auto selection = std::move(*mPendingSelection);
+    mPendingSelection.reset();
+    selection.Query.finish();
+
+    const bool isInterrupted = IsSelectionInterrupted();
+    mSelectionInterruption.RunningId.store(0);
+    mSortKeyIndex.reset();
+
+    if (isInterrupted)
     {
-        emit ExportFinished("Export file is not valid");
-        return;
+        /// Версия прерванной выборки отбрасывается, новую выборку выполнит следующий запрос
+        mIsIdMappingActual = false;
+        mSqlCacheTracer.Info(QString("%1: interrupted after %2 ms")
+            .arg(Q_FUNC_INFO)
+            .arg(QDateTime::currentDateTime().toMSecsSinceEpoch() - selection.StartTime));
+        return false;
+    }
+    if (!selection.Error.isEmpty())
+    {
+        /// Прочитана только часть выборки, такая версия не публикуется
+        mIsIdMappingActual = false;
+        mSqlCacheTracer.Warning(QString("%1: selection failed after %2 rows: %3")
+            .arg(Q_FUNC_INFO)
+            .arg(selection.Ids.GetSize())
+            .arg(selection.Error));
+        return false;
     }
 
-    int i = -1;
-    QSqlRecord record;
-
-    auto cellGetter = [&](int aRow, int aColumn)
+    const auto d = QDateTime::currentDateTime().toMSecsSinceEpoch();
+    if (selection.HasSortKeys && mUseOrderIndex)
     {
-        if (aRow != i)
+        if (selection.IsOrdered)
         {
-            i = aRow;
-            record = GetRecord(aRow);
+            mSortKeyIndex = std::make_shared<SortKeyIndex>(SortKeyLess { this, selection.SortColumns });
+            mSortKeyIndex->Assign(std::move(selection.SortKeyRows));
+            selection.Ids.SortKeys = mSortKeyIndex;
         }
-        return record.value(aColumn);
-    };
+        else
+        {
+            mSqlCacheTracer.Warning(QString("%1: ORDER BY differs from sort keys comparison, order index is not built")
+                .arg(Q_FUNC_INFO));
+        }
+    }
 
-    IterateTable(
-        mViewWindowValues.RecordsCount,
-        cellGetter,
-        &exp,
-        aColumns,
-        0,
-        [this](int aProgress){ emit ExportProgressChanged(aProgress); },
-        [this](){ return mStopExport.load(); });
+    ProcessDataPopulation(std::move(selection.Ids), true);
+    mIsIdMappingActual = selection.IsSelected;
+    TouchSortIndex();
 
-    exp.CloseFile();
-    if (mStopExport.load())
+    /// Изменения схемы, отложенные на время чтения выборки
+    if (mUseFullTextIndex != mTable.HasFullTextIndex())
     {
-        QFile file( aExportFileName );
-        file.remove();
+        SetFullTextIndex(mUseFullTextIndex);
     }
-    mStopExport.store(false);
-    emit ExportFinished(QString());
+    if (mUseReaderConnection != static_cast<bool>(mReader))
+    {
+        On_SetReaderConnection(mUseReaderConnection);
+    }
+
+    mSqlCacheTracer.Trace("PerformSelection: " + selection.Sql);
+    mSqlCacheTracer.Trace(QString("%1: query: %2 ms, reading: %3 ms, processing: %4 ms")
+        .arg(Q_FUNC_INFO)
+        .arg(selection.QueryDuration)
+        .arg(d - selection.StartTime - selection.QueryDuration)
+        .arg(QDateTime::currentDateTime().toMSecsSinceEpoch() - d));
+    return true;
 }
 
-QString SyncSqlCache::OrderByClause() const
+bool SyncSqlCache::SetSelectionInterruptible(bool aIsInterruptible)
 {
-    auto columnName = [this](int i) { return mTable.GetColumnName(i) + " %1"; };
+    /// Соединение может использоваться другими таблицами, поэтому обработчик
+    /// устанавливается только на время чтения выборки
+    return SqliteUtils::SetInterruptionHandler(
+        mDbConnection.GetDatabase(),
+        aIsInterruptible ? &mSelectionInterruption : nullptr);
+}
 
-    auto transformer = [&](const auto& aSequence, QStringList& outColumns)
-    {
-        for (auto column : aSequence)
-        {
-            outColumns << columnName(column);
-        }
-    };
+bool SyncSqlCache::IsSelectionInterrupted() const
+{
+    return mSelectionInterruption.IsInterrupted();
+}
 
-    if ((mSortColumn < 0 || mSortColumn >= mTable.GetColumnCount())
-        && mDefaultSortOrder.empty())
+bool SyncSqlCache::TryApplyBatchChanges()
+{
+    const auto* ids = GetCurrentIdMapping();
+    if (!mIsIdMappingActual || !mBatchChanges.IsComplete || !ids)
     {
-        return QString();
+        return false;
     }
 
-    QStringList defaultColumnList;
-    QStringList columnList;
-    for (const auto& sortSequence : mDefaultSortOrder)
+    const auto sortColumns = GetSortColumns();
+    const std::vector<qlonglong> changedIds(mBatchChanges.ChangedIds.cbegin(), mBatchChanges.ChangedIds.cend());
+    auto changedRows = GetSortKeys(changedIds, sortColumns, true);
+    if (mSortKeyIndex)
     {
-        if (columnList.empty())
+        return TryApplyBatchChangesToSortKeyIndex(*ids, sortColumns, std::move(changedRows));
+    }
+    if (ids->Changes)
+    {
+        /// Индекс версии отключен, вектора id у нее нет
+        return false;
+    }
+
+    /// Строки, которые остались в выборке на прежнем месте, только перечитываются в окне.
+    /// Строки, которых не было в выборке, добавляются в newRows.
+    std::unordered_set<qlonglong> refreshedIds;
+    std::vector<SortKeyRow> newRows;
+    for (const auto& row : changedRows)
+    {
+        if (!ids->GetRow(row.Id))
+        {
+            newRows.push_back(row);
+            continue;
+        }
+
+        auto oldKeyIt = mBatchChanges.OldKeys.find(row.Id);
+        if (oldKeyIt == mBatchChanges.OldKeys.cend()
+            || CompareSortKeys(oldKeyIt->second, row.Key, sortColumns) != 0)
+        {
+            /// Строка сместилась
+            return false;
+        }
+        refreshedIds.insert(row.Id);
+    }
+
+    /// Удаленные строки выборки и строки, которые перестали удовлетворять фильтру,
+    /// исключаются из текущего вектора id без повторной выборки.
+    std::unordered_set<qlonglong> removedIds;
+    for (const auto id : mBatchChanges.DeletedIds)
+    {
+        if (ids->GetRow(id))
+        {
+            removedIds.insert(id);
+        }
+    }
+    for (const auto id : changedIds)
+    {
+        if (!refreshedIds.count(id) && ids->GetRow(id))
+        {
+            removedIds.insert(id);
+        }
+    }
+
+    if (newRows.empty() && removedIds.empty())
+    {
+        RefreshViewWindowRows(refreshedIds);
+        return true;
+    }
+
+    std::vector<qlonglong> remainingIds;
+    if (removedIds.empty())
+    {
+        remainingIds = ids->Ids;
+    }
+    else
+    {
+        remainingIds.reserve(ids->Ids.size() - removedIds.size());
+        std::copy_if(ids->Ids.cbegin(), ids->Ids.cend(), std::back_inserter(remainingIds), [&removedIds](qlonglong aId)
+        {
+            return !removedIds.count(aId);
+        });
+    }
+
+    std::sort(newRows.begin(), newRows.end(), [&](const SortKeyRow& aLeft, const SortKeyRow& aRight)
+    {
+        return CompareSortKeys(aLeft.Key, aRight.Key, sortColumns) < 0;
+    });
+
+    /// Новые строки должны целиком располагаться после последней или перед первой строкой выборки
+    bool isAppend = true;
+    if (!newRows.empty() && !remainingIds.empty())
+    {
+        const auto boundaryRows = GetSortKeys({ remainingIds.front(), remainingIds.back() }, sortColumns, false);
+        auto findKey = [&](qlonglong aId) -> const QVariantList*
+        {
+            auto it = std::find_if(boundaryRows.cbegin(), boundaryRows.cend(), [aId](const SortKeyRow& aRow)
+            {
+                return aRow.Id == aId;
+            });
+            return it != boundaryRows.cend() ? &it->Key : nullptr;
+        };
+        const auto* frontKey = findKey(remainingIds.front());
+        const auto* backKey = findKey(remainingIds.back());
+        if (!frontKey || !backKey)
+        {
+            return false;
+        }
+
+        if (CompareSortKeys(newRows.front().Key, *backKey, sortColumns) > 0)
+        {
+            isAppend = true;
+        }
+        else if (CompareSortKeys(newRows.back().Key, *frontKey, sortColumns) < 0)
+        {
+            isAppend = false;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    IdsInfo nextIds;
+    nextIds.Ids.reserve(remainingIds.size() + newRows.size());
+    if (isAppend)
+    {
+        nextIds.Ids = std::move(remainingIds);
+        if (removedIds.empty())
+        {
+            /// Позиции существующих строк не меняются
+            nextIds.IdPositions = std::move(ids->IdPositions);
+            ids->IdPositions.clear();
+        }
+    }
+    for (const auto& row : newRows)
+    {
+        nextIds.AddId(row.Id);
+    }
+    if (!isAppend)
+    {
+        nextIds.Ids.insert(nextIds.Ids.end(), remainingIds.cbegin(), remainingIds.cend());
+    }
+
+    mSqlCacheTracer.Trace(QString("%1: %2 rows removed, %3 rows %4")
+        .arg(Q_FUNC_INFO)
+        .arg(removedIds.size())
+        .arg(newRows.size())
+        .arg(isAppend ? "appended" : "prepended"));
+
+    ProcessDataPopulation(std::move(nextIds), false, refreshedIds);
+    return true;
+}
+
+bool SyncSqlCache::TryApplyBatchChangesToSortKeyIndex(
+    const IdsInfo& aIds,
+    const TSortColumns& aSortColumns,
+    std::vector<SortKeyRow>&& aChangedRows)
+{
+    auto& index = *mSortKeyIndex;
+    if (aIds.SortKeys != mSortKeyIndex || index.Tree.Size() != aIds.GetSize())
+    {
+        mSqlCacheTracer.Warning(QString("%1: order index is out of sync").arg(Q_FUNC_INFO));
+        mSortKeyIndex.reset();
+        return false;
+    }
+
+    std::unordered_set<qlonglong> filteredIds;
+    std::unordered_set<qlonglong> refreshedIds;
+    std::vector<qlonglong> removedIds;
+    std::vector<SortKeyRow> insertedRows;
+    for (auto& row : aChangedRows)
+    {
+        filteredIds.insert(row.Id);
+        if (const auto* oldKey = index.GetKey(row.Id))
+        {
+            if (CompareSortKeys(*oldKey, row.Key, aSortColumns) == 0)
+            {
+                refreshedIds.insert(row.Id);
+                continue;
+            }
+            removedIds.push_back(row.Id);
+        }
+        insertedRows.push_back(std::move(row));
+    }
+
+    /// Удаленные строки и строки, которые перестали удовлетворять фильтру
+    auto removeFiltered = [&](qlonglong aId)
+    {
+        if (!filteredIds.count(aId) && index.GetKey(aId))
+        {
+            removedIds.push_back(aId);
+        }
+    };
+    for (const auto id : mBatchChanges.DeletedIds)
+    {
+        removeFiltered(id);
+    }
+    for (const auto id : mBatchChanges.ChangedIds)
+    {
+        removeFiltered(id);
+    }
+
+    if (removedIds.empty() && insertedRows.empty())
+    {
+        RefreshViewWindowRows(refreshedIds);
+        return true;
+    }
+
+    /// Новая версия хранит только изменение позиций: позиции удаленных строк
+    /// берутся до изменения индекса, позиции вставленных - после.
+    /// Вектор id строк из индекса не копируется.
+    PositionChanges changes;
+    std::unordered_map<qlonglong, size_t> removedRows;
+    changes.RemovedRows.reserve(removedIds.size());
+    for (const auto id : removedIds)
+    {
+        const auto row = index.GetRow(id);
+        if (!row)
+        {
+            mSqlCacheTracer.Warning(QString("%1: order index is out of sync").arg(Q_FUNC_INFO));
+            mSortKeyIndex.reset();
+            return false;
+        }
+        changes.RemovedRows.push_back(*row);
+        removedRows.emplace(id, *row);
+    }
+
+    bool isConsistent = true;
+    for (const auto id : removedIds)
+    {
+        isConsistent &= index.Erase(id);
+    }
+    std::vector<qlonglong> insertedIds;
+    insertedIds.reserve(insertedRows.size());
+    for (auto& row : insertedRows)
+    {
+        insertedIds.push_back(row.Id);
+        isConsistent &= index.Insert(std::move(row));
+    }
+    if (!isConsistent)
+    {
+        mSqlCacheTracer.Warning(QString("%1: order index is out of sync").arg(Q_FUNC_INFO));
+        mSortKeyIndex.reset();
+        return false;
+    }
+
+    std::vector<size_t> insertedPositions;
+    insertedPositions.reserve(insertedIds.size());
+    for (const auto id : insertedIds)
+    {
+        const auto row = *index.GetRow(id);
+        insertedPositions.push_back(row);
+        if (auto removedIt = removedRows.find(id); removedIt != removedRows.cend())
+        {
+            changes.MovedRows.emplace(removedIt->second, row);
+        }
+    }
+    std::sort(changes.RemovedRows.begin(), changes.RemovedRows.end());
+    std::sort(insertedPositions.begin(), insertedPositions.end());
+    changes.InsertedOffsets.reserve(insertedPositions.size());
+    for (size_t i = 0; i < insertedPositions.size(); ++i)
+    {
+        changes.InsertedOffsets.push_back(insertedPositions[i] - i);
+    }
+
+    IdsInfo nextIds;
+    nextIds.SortKeys = mSortKeyIndex;
+    nextIds.Changes = std::move(changes);
+    nextIds.RowsCount = index.Tree.Size();
+
+    mSqlCacheTracer.Trace(QString("%1: %2 rows removed, %3 rows inserted")
+        .arg(Q_FUNC_INFO)
+        .arg(removedIds.size())
+        .arg(insertedIds.size()));
+
+    ProcessDataPopulation(std::move(nextIds), false, refreshedIds);
+    return true;
+}
+
+void SyncSqlCache::RefreshViewWindowRows(const std::unordered_set<qlonglong>& aRefreshedIds)
+{
+    if (aRefreshedIds.empty())
+    {
+        return;
+    }
+
+    /// Порядок и состав выборки не изменились, новая версия IdsInfo не нужна
+    mSqlCacheTracer.Trace(QString("%1: %2 rows refreshed")
+        .arg(Q_FUNC_INFO)
+        .arg(aRefreshedIds.size()));
+
+    /// Строки текущего окна модель заменит сама, остальные строки прежних окон устаревают
+    std::unordered_set<qlonglong> windowIds;
+    for (const auto& row : std::as_const(mViewWindowValues.Data))
+    {
+        windowIds.insert(row.value(mIdColumn).toLongLong());
+    }
+    for (const auto id : aRefreshedIds)
+    {
+        if (!windowIds.count(id))
+        {
+            ++mRowsRevision;
+            break;
+        }
+    }
+    UpdateViewWindowValues(false, aRefreshedIds);
+    if (mOperationHandler)
+    {
+        mOperationHandler->ProcessDataSelected();
+    }
+}
+
+std::vector<SyncSqlCache::SortKeyRow> SyncSqlCache::GetSortKeys(
+    const std::vector<qlonglong>& aIds,
+    const TSortColumns& aSortColumns,
+    bool aIsFiltered)
+{
+    QStringList columns;
+    for (const auto& sortColumn : aSortColumns)
+    {
+        columns << mTable.GetColumnName(sortColumn.Column);
+    }
+
+    std::vector<SortKeyRow> result;
+    result.reserve(aIds.size());
+    for (size_t i = 0; i < aIds.size(); i += SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER)
+    {
+        const auto count = (std::min)(aIds.size() - i, static_cast<size_t>(SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER));
+        QVariantList params;
+        for (size_t j = i; j < i + count; ++j)
+        {
+            params << aIds[j];
+        }
+
+        auto sql = QString("SELECT id, %1 FROM %2 WHERE id IN (%3) AND (%4)")
+            .arg(columns.join(","))
+            .arg(SqlQueryUtils::TablePlaceholder)
+            .arg(SqlCacheTable::CreateParameters(static_cast<int>(count)))
+            .arg(SqlQueryUtils::FilterPlaceholder);
+        mTable.PerformSql(sql, params, aIsFiltered ? mFilter : QString(), true);
+
+        auto& query = mTable.GetLastQuery();
+        while (query.next())
+        {
+            SortKeyRow row { query.value(0).toLongLong(), {} };
+            for (int column = 1; column <= columns.size(); ++column)
+            {
+                row.Key << query.value(column);
+            }
+            result.push_back(std::move(row));
+        }
+        query.finish();
+    }
+    return result;
+}
+
+std::unordered_map<qlonglong, qlonglong> SyncSqlCache::GetItemsRevisions(const std::vector<qlonglong>& aIds)
+{
+    std::unordered_map<qlonglong, qlonglong> result;
+    result.reserve(aIds.size());
+    for (size_t i = 0; i < aIds.size(); i += SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER)
+    {
+        const auto count = (std::min)(aIds.size() - i, static_cast<size_t>(SqlQueryUtils::SQLITE_MAX_VARIABLE_NUMBER));
+        QVariantList params;
+        for (size_t j = i; j < i + count; ++j)
+        {
+            params << aIds[j];
+        }
+
+        auto sql = QString("SELECT id, %1 FROM %2 WHERE id IN (%3)")
+            .arg(SqlQueryUtils::RevisionColumn)
+            .arg(SqlQueryUtils::TablePlaceholder)
+            .arg(SqlCacheTable::CreateParameters(static_cast<int>(count)));
+        mTable.PerformSql(sql, params, QString(), true);
+
+        auto& query = mTable.GetLastQuery();
+        while (query.next())
+        {
+            result.emplace(query.value(0).toLongLong(), query.value(1).toLongLong());
+        }
+        query.finish();
+    }
+    return result;
+}
+
+int SyncSqlCache::CompareSortKeys(
+    const QVariantList& aLeft,
+    const QVariantList& aRight,
+    const TSortColumns& aSortColumns) const
+{
+    for (int i = 0; i < static_cast<int>(aSortColumns.size()); ++i)
+    {
+        const auto& sortColumn = aSortColumns[static_cast<size_t>(i)];
+        const auto result = SqlQueryUtils::CompareSqlValues(
+            aLeft.value(i),
+            aRight.value(i),
+            mTable.GetColumnType(sortColumn.Column) == SqlFieldType::StringCollateNoCase);
+        if (result != 0)
+        {
+            return sortColumn.Order == Qt::AscendingOrder ? result : -result;
+        }
+    }
+    return 0;
+}
+
+bool SyncSqlCache::SortKeyLess::operator()(const SortKeyRow& aLeft, const SortKeyRow& aRight) const
+{
+    return Cache->CompareSortKeys(aLeft.Key, aRight.Key, Columns) < 0;
+}
+
+SyncSqlCache::SortKeyIndex::SortKeyIndex(SortKeyLess aLess)
+    : Tree(std::move(aLess))
+{}
+
+void SyncSqlCache::SortKeyIndex::Assign(std::vector<SortKeyRow>&& aSortedRows)
+{
+    Keys.clear();
+    Keys.reserve(aSortedRows.size());
+    for (const auto& row : aSortedRows)
+    {
+        Keys.emplace(row.Id, row.Key);
+    }
+    Tree.Assign(std::move(aSortedRows));
+}
+
+std::optional<size_t> SyncSqlCache::SortKeyIndex::GetRow(qlonglong aId) const
+{
+    const auto* key = GetKey(aId);
+    if (!key)
+    {
+        return std::nullopt;
+    }
+    return Tree.Rank(SortKeyRow { aId, *key });
+}
+
+const QVariantList* SyncSqlCache::SortKeyIndex::GetKey(qlonglong aId) const
+{
+    auto it = Keys.find(aId);
+    return it != Keys.cend() ? &it->second : nullptr;
+}
+
+bool SyncSqlCache::SortKeyIndex::Insert(SortKeyRow aRow)
+{
+    if (Keys.count(aRow.Id))
+    {
+        return false;
+    }
+    Keys.emplace(aRow.Id, aRow.Key);
+    return Tree.Insert(std::move(aRow));
+}
+
+bool SyncSqlCache::SortKeyIndex::Erase(qlonglong aId)
+{
+    auto it = Keys.find(aId);
+    if (it == Keys.cend())
+    {
+        return false;
+    }
+    const bool isErased = Tree.Erase(SortKeyRow { aId, it->second });
+    Keys.erase(it);
+    return isErased;
+}
+
+std::optional<size_t> SyncSqlCache::PositionChanges::Transform(size_t aRow) const
+{
+    const auto removedIt = std::lower_bound(RemovedRows.cbegin(), RemovedRows.cend(), aRow);
+    if (removedIt != RemovedRows.cend() && *removedIt == aRow)
+    {
+        auto movedIt = MovedRows.find(aRow);
+        if (movedIt == MovedRows.cend())
+        {
+            return std::nullopt;
+        }
+        return movedIt->second;
+    }
+
+    /// Позиция среди оставшихся строк, затем сдвиг на вставленные перед ней строки
+    const auto remainingRow = aRow - static_cast<size_t>(removedIt - RemovedRows.cbegin());
+    const auto insertedBefore = std::upper_bound(InsertedOffsets.cbegin(), InsertedOffsets.cend(), remainingRow)
+        - InsertedOffsets.cbegin();
+    return remainingRow + static_cast<size_t>(insertedBefore);
+}
+
+void SyncSqlCache::SetSorting(const TSortParametersArg& aSorting)
+{
+    if (!aSorting)
+    {
+        return;
+    }
+
+    mSortColumn = aSorting->Column;
+    mSortOrder = static_cast<Qt::SortOrder>(aSorting->Order);
+
+    mSqlCacheTracer.Info(QString("%1: mSortColumn: %2, mSortOrder: %3")
+        .arg(Q_FUNC_INFO)
+        .arg(mSortColumn)
+        .arg((mSortOrder == Qt::AscendingOrder) ? QString("asc") : QString("desc")));
+}
+
+void SyncSqlCache::SetFilter(const TFilterParametersArg& aFilter)
+{
+    if (!aFilter)
+    {
+        return;
+    }
+
+    mFilter = mUseFoldedColumns
+        ? SqlQueryUtils::GetFoldedColumnFilter(*aFilter, GetCommonColumns())
+        : *aFilter;
+    mSqlCacheTracer.Info(QString("%1: %2").arg(Q_FUNC_INFO).arg(mFilter));
+}
+
+void SyncSqlCache::On_PerformSelect(QString aSql, QVariantList aParams)
+{
+    if (mReader)
+    {
+        QMetaObject::invokeMethod(
+            mReader,
+            [reader = mReader, aSql, aParams, filter = mFilter]()
+            {
+                reader->PerformSelect(aSql, aParams, filter);
+            },
+            Qt::QueuedConnection);
+        return;
+    }
+
+    auto query = PerformSqlSafe(aSql, aParams);
+
+    if (!query.isSelect())
+    {
+        static constexpr char error[] = "On_PerformSelect: only select statements allowed here";
+        mSqlCacheTracer.Error(error);
+        emit ErrorOccured(error);
+        return;
+    }
+
+    QVariantList result;
+    while (query.next())
+    {
+        result.push_back(Record2List(query.record()));
+    }
+
+    emit UserQueryPerformed(result);
+}
+
+QVariantList SyncSqlCache::Record2List(const QSqlRecord& aRecord)
+{
+    QVariantList row;
+    for (int i = 0; i < aRecord.count(); ++i)
+    {
+        row.push_back(aRecord.value(i));
+    }
+    return row;
+}
+
+void SyncSqlCache::SetUpdatesFromDbAllowed(LoadingStatus aLoadingStatus)
+{
+    if (aLoadingStatus == LoadingStatus::NotChanged)
+    {
+        return;
+    }
+    
+    mIsSelectionAllowed = (aLoadingStatus == LoadingStatus::Finished);
+}
+
+void SyncSqlCache::OnExport(const QString &aExportFileName, const ColumnsExportInfo &aColumns)
+{
+    if (mReader)
+    {
+        /// Читатель экспортирует строки текущей версии выборки
+        QVector<qlonglong> ids;
+        if (const auto* idMapping = GetCurrentIdMapping())
         {
-            auto it = std::find(sortSequence.cbegin(), sortSequence.cend(), mSortColumn);
-            if (it != sortSequence.cend())
+            idMapping->CopyIds(static_cast<size_t>((std::max)(mViewWindowValues.RecordsCount, 0)), ids);
+        }
+        QMetaObject::invokeMethod(
+            mReader,
+            [reader = mReader, aExportFileName, aColumns, ids = std::move(ids)]()
             {
-                transformer(sortSequence, columnList);
-                continue;
-            }
+                reader->Export(aExportFileName, aColumns, ids);
+            },
+            Qt::QueuedConnection);
+        return;
+    }
+
+    CsvExporter exp(aExportFileName);
+    if(!exp.IsReadyForWrite())
+    {
+        emit ExportFinished("Export file is not valid");
+        return;
+    }
+
+    int i = -1;
+    QSqlRecord record;
+
+    auto cellGetter = [&](int aRow, int aColumn)
+    {
+        if (aRow != i)
+        {
+            i = aRow;
+            record = GetRecord(aRow);
+        }
+        return record.value(aColumn);
+    };
+
+    IterateTable(
+        mViewWindowValues.RecordsCount,
+        cellGetter,
+        &exp,
+        aColumns,
+        0,
+        [this](int aProgress){ emit ExportProgressChanged(aProgress); },
+        [this](){ return mStopExport->load(); });
+
+    exp.CloseFile();
+    if (mStopExport->load())
+    {
+        QFile file( aExportFileName );
+        file.remove();
+    }
+    mStopExport->store(false);
+    emit ExportFinished(QString());
+}
+
+SyncSqlCache::TSortColumns SyncSqlCache::GetSortColumns() const
+{
+    const bool isSortColumnValid = mSortColumn >= 0 && mSortColumn < mTable.GetColumnCount();
+
+    TSortColumns columns;
+    TSortColumns defaultColumns;
+    for (const auto& sortSequence : mDefaultSortOrder)
+    {
+        const bool isSortSequence = columns.empty()
+            && std::find(sortSequence.cbegin(), sortSequence.cend(), mSortColumn) != sortSequence.cend();
+        auto& target = isSortSequence ? columns : defaultColumns;
+        for (auto column : sortSequence)
+        {
+            target.push_back(SortColumn { column, mSortOrder });
         }
-        transformer(sortSequence, defaultColumnList);
     }
 
-    QString sortOrder = (mSortOrder == Qt::AscendingOrder) ? "ASC" : "DESC";
-    QString defaultSortOrder = sortOrder;
+    auto defaultSortOrder = mSortOrder;
+    if (columns.empty() && isSortColumnValid)
+    {
+        columns.push_back(SortColumn { mSortColumn, mSortOrder });
+        defaultSortOrder = mDefaultSortDirection;
+    }
+
+    for (auto& column : defaultColumns)
+    {
+        column.Order = defaultSortOrder;
+        columns.push_back(column);
+    }
+
+    const bool hasIdColumn = std::any_of(
+        columns.cbegin(),
+        columns.cend(),
+        [this](const SortColumn& aColumn) { return aColumn.Column == mIdColumn; });
+    if (!columns.empty() && !hasIdColumn)
+    {
+        columns.push_back(SortColumn { mIdColumn, columns.back().Order });
+    }
+
+    return columns;
+}
+
+QString SyncSqlCache::OrderByClause() const
+{
+    const auto sortColumns = GetSortColumns();
+    if (sortColumns.empty())
+    {
+        return QString();
+    }
+
+    QStringList columnList;
+    for (const auto& sortColumn : sortColumns)
+    {
+        columnList << QString("%1 %2")
+            .arg(mTable.GetColumnName(sortColumn.Column))
+            .arg((sortColumn.Order == Qt::AscendingOrder) ? "ASC" : "DESC");
+    }
+
+    return "ORDER BY " + columnList.join(", ");
+}
+
+QString SyncSqlCache::GetSortIndexColumns(const TSortColumns& aSortColumns) const
+{
+    if (aSortColumns.empty())
+    {
+        return QString();
+    }
+
+    const auto firstOrder = aSortColumns.front().Order;
+    auto lastOrder = Qt::AscendingOrder;
+    bool hasIdColumn = false;
+
+    QStringList columnList;
+    for (const auto& sortColumn : aSortColumns)
+    {
+        lastOrder = (sortColumn.Order == firstOrder) ? Qt::AscendingOrder : Qt::DescendingOrder;
+        hasIdColumn |= (sortColumn.Column == mIdColumn);
+        columnList << QString("%1 %2")
+            .arg(mTable.GetColumnName(sortColumn.Column))
+            .arg((lastOrder == Qt::AscendingOrder) ? "ASC" : "DESC");
+    }
+
+    /// id замыкает индекс, чтобы порядок строк с одинаковыми ключами был определен
+    if (!hasIdColumn)
+    {
+        columnList << QString("%1 %2")
+            .arg(mTable.GetColumnName(mIdColumn))
+            .arg((lastOrder == Qt::AscendingOrder) ? "ASC" : "DESC");
+    }
+
+    return columnList.join(", ");
+}
+
+void SyncSqlCache::TouchSortIndex()
+{
+    const auto columns = GetSortIndexColumns(GetSortColumns());
+    if (columns.isEmpty())
+    {
+        return;
+    }
+
+    auto it = std::find_if(
+        mSortIndexes.begin(),
+        mSortIndexes.end(),
+        [&](const SortIndex& aIndex) { return aIndex.Columns == columns; });
+
+    if (it != mSortIndexes.end())
+    {
+        mSortIndexes.splice(mSortIndexes.begin(), mSortIndexes, it);
+    }
+    else
+    {
+        mSortIndexes.push_front(SortIndex {
+            QString("%1_idx%2").arg(mTable.GetName()).arg(++mSortIndexesCounter),
+            columns,
+            false });
+    }
+}
+
+void SyncSqlCache::ScheduleSortIndexesMaintenance()
+{
+    if (!mIsSelectionAllowed)
+    {
+        /// Во время первоначальной загрузки индексы только замедляют вставку
+        return;
+    }
+
+    int position = 0;
+    bool isMaintenanceNeeded = false;
+    for (const auto& index : mSortIndexes)
+    {
+        isMaintenanceNeeded |= (position++ < mSortIndexesBudget) != index.IsCreated;
+    }
+
+    if (isMaintenanceNeeded)
+    {
+        /// Перезапуск таймера откладывает построение, пока таблица используется
+        mSortIndexesTimer.start();
+    }
+}
 
-    if (columnList.empty()
-        && (mSortColumn >= 0)
-        && (mSortColumn < mTable.GetColumnCount()))
+void SyncSqlCache::MaintainSortIndexes()
+{
+    if (mPendingSelection)
     {
-        columnList << columnName(mSortColumn);
-        defaultSortOrder = (mDefaultSortDirection == Qt::AscendingOrder) ? "ASC" : "DESC";
+        /// Курсор выборки еще читается
+        mSortIndexesTimer.start();
+        return;
     }
 
-    QString sortColumns;
-    if (!columnList.empty())
+    /// Открытые курсоры блокируют изменение схемы
+    mTable.FinishQueries();
+    mSuspendedItemsTable.FinishQueries();
+
+    int position = 0;
+    for (auto it = mSortIndexes.begin(); it != mSortIndexes.end(); ++position)
     {
-        sortColumns = columnList.join(", ").arg(sortOrder);
+        if (position < mSortIndexesBudget)
+        {
+            ++it;
+            continue;
+        }
+
+        if (it->IsCreated)
+        {
+            try { mTable.DropIndex(it->Name); }
+            catch (std::runtime_error&)
+            {
+                mSqlCacheTracer.Warning(QString("%1: %2").arg(Q_FUNC_INFO).arg(mTable.GetLastError()));
+            }
+        }
+        it = mSortIndexes.erase(it);
     }
-    if (!defaultColumnList.empty())
+
+    /// Строим по одному индексу за раз, чтобы не блокировать поток надолго
+    auto it = std::find_if(
+        mSortIndexes.begin(),
+        mSortIndexes.end(),
+        [](const SortIndex& aIndex) { return !aIndex.IsCreated; });
+    if (it != mSortIndexes.end())
     {
-        if (!sortColumns.isEmpty())
+        const auto d = QDateTime::currentDateTime().toMSecsSinceEpoch();
+        try
+        {
+            mTable.CreateIndex(it->Name, it->Columns);
+            it->IsCreated = true;
+            mSqlCacheTracer.Trace(QString("%1: %2 (%3): %4 ms")
+                .arg(Q_FUNC_INFO)
+                .arg(it->Name)
+                .arg(it->Columns)
+                .arg(QDateTime::currentDateTime().toMSecsSinceEpoch() - d));
+        }
+        catch (std::runtime_error&)
         {
-            sortColumns.append(", ");
+            /// Индекс - только оптимизация, поэтому ошибку не передаем в модель
+            mSqlCacheTracer.Warning(QString("%1: %2").arg(Q_FUNC_INFO).arg(mTable.GetLastError()));
+            mSortIndexes.erase(it);
         }
-        sortColumns.append(defaultColumnList.join(", ").arg(defaultSortOrder));
     }
 
-    return "ORDER BY " + sortColumns;
+    ScheduleSortIndexesMaintenance();
 }
 
 void SyncSqlCache::On_SetAutoScroll(bool aIsAutoScroll)
@@ -1343,6 +2949,210 @@ void SyncSqlCache::On_SetAutoScroll(bool aIsAutoScroll)
     mIsAutoScroll = aIsAutoScroll;
 }
 
+void SyncSqlCache::On_SetFullTextIndex(bool aIsEnabled)
+{
+    mUseFullTextIndex = aIsEnabled;
+    if (mPendingSelection)
+    {
+        /// Индекс будет изменен после чтения выборки
+        return;
+    }
+    SetFullTextIndex(mUseFullTextIndex);
+}
+
+void SyncSqlCache::On_SetOrderIndex(bool aIsEnabled)
+{
+    mUseOrderIndex = aIsEnabled;
+    if (!mUseOrderIndex)
+    {
+        mSortKeyIndex.reset();
+    }
+    /// Иначе дерево строится при следующей выборке
+}
+
+void SyncSqlCache::On_SetReaderConnection(bool aIsEnabled)
+{
+    if (aIsEnabled && !mIsFile)
+    {
+        mSqlCacheTracer.Warning(QString("%1: reader connection requires file storage").arg(Q_FUNC_INFO));
+        return;
+    }
+
+    mUseReaderConnection = aIsEnabled;
+    if (mPendingSelection)
+    {
+        /// Режим журнала будет изменен после чтения выборки
+        return;
+    }
+
+    if (mUseReaderConnection)
+    {
+        StartReaderConnection();
+    }
+    else
+    {
+        StopReaderConnection();
+    }
+}
+
+void SyncSqlCache::StartReaderConnection()
+{
+    if (mReader)
+    {
+        return;
+    }
+
+    /// Смена режима журнала невозможна при открытых курсорах
+    mTable.FinishQueries();
+    mSuspendedItemsTable.FinishQueries();
+
+    QSqlQuery query { mDbConnection.GetDatabase() };
+    if (!query.exec("PRAGMA journal_mode=WAL")
+        || !query.next()
+        || query.value(0).toString().compare("wal", Qt::CaseInsensitive) != 0)
+    {
+        mSqlCacheTracer.Warning(QString("%1: WAL is not enabled: %2")
+            .arg(Q_FUNC_INFO)
+            .arg(query.lastError().text()));
+        mUseReaderConnection = false;
+        return;
+    }
+    query.finish();
+
+    mReader = new SqlReaderConnection(
+        mDbConnection.GetDatabase().databaseName(),
+        mTable.GetName(),
+        mTable.GetFields(),
+        mIdColumn,
+        mStopExport);
+    mReaderThread = DbThreadPool::Instance().Acquire();
+    mReader->moveToThread(mReaderThread);
+
+    connect(mReader, &SqlReaderConnection::Opened, this, [this](bool aIsOpen)
+    {
+        if (!aIsOpen)
+        {
+            mSqlCacheTracer.Warning(QString("%1: reader connection is not opened").arg(Q_FUNC_INFO));
+            mUseReaderConnection = false;
+            StopReaderConnection();
+        }
+    });
+    connect(mReader, &SqlReaderConnection::SelectPerformed, this, &SyncSqlCache::UserQueryPerformed);
+    connect(mReader, &SqlReaderConnection::ErrorOccured, this, [this](const QString& aError)
+    {
+        mSqlCacheTracer.Error(aError);
+        emit ErrorOccured(aError);
+    });
+    connect(mReader, &SqlReaderConnection::ExportProgressChanged, this, &SyncSqlCache::ExportProgressChanged);
+    connect(mReader, &SqlReaderConnection::ExportFinished, this, [this](const QString& aError)
+    {
+        mStopExport->store(false);
+        emit ExportFinished(aError);
+    });
+
+    QMetaObject::invokeMethod(mReader, &SqlReaderConnection::Open, Qt::QueuedConnection);
+}
+
+void SyncSqlCache::StopReaderConnection()
+{
+    if (!mReaderThread)
+    {
+        return;
+    }
+
+    /// Читатель удаляется в своем потоке после уже поставленных запросов, хранилище удаления не ждет.
+    /// Поток возвращается в пул после удаления читателя.
+    if (mReader)
+    {
+        QObject::connect(
+            mReader, &QObject::destroyed,
+            [thread = mReaderThread]() { DbThreadPool::Instance().Release(thread); });
+        mReader->deleteLater();
+    }
+    else
+    {
+        DbThreadPool::Instance().Release(mReaderThread);
+    }
+    mReaderThread = nullptr;
+    mReader = nullptr;
+}
+
+void SyncSqlCache::SetFullTextIndex(bool aIsEnabled)
+{
+    if (aIsEnabled == mTable.HasFullTextIndex())
+    {
+        return;
+    }
+
+    const auto columns = GetCommonColumns();
+    if (aIsEnabled && columns.empty())
+    {
+        mSqlCacheTracer.Warning(QString("%1: no common columns").arg(Q_FUNC_INFO));
+        mUseFullTextIndex = false;
+        return;
+    }
+
+    /// Открытые курсоры блокируют изменение схемы
+    mTable.FinishQueries();
+    mSuspendedItemsTable.FinishQueries();
+
+    try
+    {
+        if (aIsEnabled)
+        {
+            const auto d = QDateTime::currentDateTime().toMSecsSinceEpoch();
+            mTable.CreateFullTextIndex(columns);
+            mSqlCacheTracer.Info(QString("%1: %2 (%3): %4 ms")
+                .arg(Q_FUNC_INFO)
+                .arg(mTable.GetFullTextIndexName())
+                .arg(columns.join(","))
+                .arg(QDateTime::currentDateTime().toMSecsSinceEpoch() - d));
+        }
+        else
+        {
+            mTable.DropFullTextIndex();
+        }
+    }
+    catch (std::runtime_error&)
+    {
+        /// Например, SQLite собран без FTS5 или trigram-токенизатора
+        mSqlCacheTracer.Warning(QString("%1: %2").arg(Q_FUNC_INFO).arg(mTable.GetLastError()));
+        mUseFullTextIndex = false;
+        /// Удаляем частично созданные объекты
+        try { mTable.DropFullTextIndex(); }
+        catch (std::runtime_error&) {}
+    }
+}
+
+QStringList SyncSqlCache::GetCommonColumns() const
+{
+    QStringList columns;
+    for (const auto& commonFieldIndexes : mCommonFieldsIndexes)
+    {
+        columns << mTable.GetColumnName(commonFieldIndexes.first);
+    }
+    return columns;
+}
+
+QString SyncSqlCache::GetSelectionFilter() const
+{
+    if (mFilter.isEmpty() || !mTable.HasFullTextIndex())
+    {
+        return mFilter;
+    }
+
+    return SqlQueryUtils::GetFullTextIndexFilter(
+        mFilter,
+        mTable.GetFullTextIndexName(),
+        mTable.GetFullTextColumns());
+}
+
+void SyncSqlCache::On_SetSortIndexesBudget(int aMaxIndexesCount)
+{
+    mSortIndexesBudget = (std::max)(aMaxIndexesCount, 0);
+    ScheduleSortIndexesMaintenance();
+}
+
 void SyncSqlCache::SetOperationHandler(const QPointer<TableOperationHandlerBase>& aHandler)
 {
     mOperationHandler = aHandler;
@@ -1355,17 +3165,32 @@ void SyncSqlCache::SetOperationHandler(const QPointer<TableOperationHandlerBase>
 
 void SyncSqlCache::StopExport()
 {
-    mStopExport.store(true);
+    mStopExport->store(true);
+}
+
+void SyncSqlCache::InterruptSelection(qint64 aRequestId)
+{
+    mSelectionInterruption.InterruptedId.store(aRequestId);
 }
 
 int SyncSqlCache::RowTransformator::Transform(int aRow) const
 {
-    auto row = New.GetRow(Old.GetId(aRow));
-    if (!row)
+    if (aRow < 0 || Versions.front()->IsOutOfRange(aRow))
     {
         return -1;
     }
-    return static_cast<int>(*row);
+
+    auto row = static_cast<size_t>(aRow);
+    for (size_t i = 1; i < Versions.size(); ++i)
+    {
+        const auto next = Versions[i]->TransformFrom(*Versions[i - 1], row);
+        if (!next)
+        {
+            return -1;
+        }
+        row = *next;
+    }
+    return static_cast<int>(row);
 }
 
 RowRange SyncSqlCache::RowTransformator::Transform(const RowRange& aRowRange) const
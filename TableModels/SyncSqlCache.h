@@ -6,14 +6,22 @@
 #include <QFutureWatcher>
 #include <QTimer>
 #include <QPointer>
+#include <QThread>
 
+#include <deque>
+#include <list>
+#include <memory>
 #include <optional>
+#include <unordered_set>
 
 #include "TextFilter/TextFilter.h"
 #include "TableOperationHandlerBase.h"
 #include "export/Exporter.h"
 #include "SqlQueryUtils.h"
 #include "SqlCacheTable.h"
+#include "SqliteUtils.h"
+#include "OrderStatisticTree.h"
+#include "SqlReaderConnection.h"
 
 using TNewItemsBuffer = std::vector<QVariantList>;
 using TNewItemsBufferPtr = QSharedPointer<TNewItemsBuffer>;
@@ -63,6 +71,10 @@ struct RowRequest
     RowRange RowWindow;
     RowRange RowWindowVisible;
     qint64 Version = 0;
+    /// Запас окна сверху и снизу от видимого диапазона.
+    /// Сохраняется хранилищем при переносе окна после изменения данных.
+    int TopMargin = SqlQueryUtils::RowWindowOffset;
+    int BottomMargin = SqlQueryUtils::RowWindowOffset;
 
     auto GetTuple() const
     {
@@ -91,9 +103,19 @@ struct HintsRequest
 };
 
 
+/// Блок строк окна. QList разделяется неявно (атомарный счетчик ссылок),
+/// поэтому передача между потоками не копирует строки.
+/// После отправки во front-поток блок не изменяется ни одной из сторон:
+/// хранилище строит для следующего окна новый блок, модель только сужает диапазон Rows.
+using TRowBlock = QList<QVariantList>;
+
 struct ViewWindowValues
 {
-    QList<QVariantList> Data;
+    TRowBlock Data;
+    /// Метки версий строк Data. Строка получает новую метку при каждом чтении
+    /// из хранилища с измененными значениями, поэтому одинаковые метки
+    /// на одной позиции означают, что строка не изменилась.
+    QVector<qint64> Stamps;
 
     /// Количество строк, удовлетворяющее фильтрам
     int RecordsCount = 0;
@@ -112,12 +134,22 @@ struct ViewWindowValues
     EdgeRowHintType BottomRowHint = EdgeRowHintType::Full;
 
     qint64 Version = 0;
+    /// Счетчик изменений значений строк без смены Version (перечитывание строк
+    /// на прежних позициях, произвольный запрос). Строки прежних окон той же
+    /// версии, сохраненные моделью, при его смене устаревают.
+    qint64 RowsRevision = 0;
     qint64 RequestId = -1;
 
     QVariant ExtraData;
 
+    /// Среднее время загрузки строки окна из хранилища, мкс
+    qint64 RowFetchCostUs = 0;
+
     const QVariantList* GetRow(int aRow) const;
+    /// Изменяемая строка отделяет блок от разделяемых копий.
     QVariantList* GetRow(int aRow);
+    /// 0 - строки нет в окне, -1 - метка строки неизвестна.
+    qint64 GetRowStamp(int aRow) const;
 
     RowRange PrepareRemoveRows(int aRecordsCount) const;
     void RemoveRows(int aRecordsCount);
@@ -126,7 +158,8 @@ struct ViewWindowValues
     RowRange PrepareAddRows(int aRecordsCount) const;
     void AddRows(int aRecordsCount);
     void SetData(
-        const QList<QVariantList>& aData,
+        const TRowBlock& aData,
+        const QVector<qint64>& aStamps,
         const RowRange& aRows,
         const RowRange& aRowsVisiable,
         const int aRecordsCount);
@@ -139,15 +172,46 @@ class SyncSqlCache : public QObject
     Q_OBJECT
 
 private:
+    struct SortKeyIndex;
+
+    /// Изменение позиций строк относительно предыдущей версии IdsInfo
+    struct PositionChanges
+    {
+        /// Позиции удаленных и смещенных строк в предыдущей версии, по возрастанию
+        std::vector<size_t> RemovedRows;
+        /// Позиции вставленных и смещенных строк в новой версии за вычетом
+        /// количества вставленных перед ними, по возрастанию
+        std::vector<size_t> InsertedOffsets;
+        /// Новые позиции смещенных строк по их позициям в предыдущей версии
+        std::unordered_map<size_t, size_t> MovedRows;
+
+        std::optional<size_t> Transform(size_t aRow) const;
+    };
+
+    /// Версия выборки. Полная выборка хранит id строк вектором.
+    /// Версия, полученная изменением mSortKeyIndex, хранит только PositionChanges,
+    /// а id и позиции строк берет из индекса. Индекс соответствует последней из
+    /// построенных по нему версий, поэтому GetId и GetRow такой версии допустимы,
+    /// пока она последняя, а строки более старых версий пересчитываются через Changes.
     struct IdsInfo
     {
         std::vector<qlonglong> Ids;
         mutable std::unordered_map<qlonglong, size_t> IdPositions;
+        std::shared_ptr<const SortKeyIndex> SortKeys;
+        std::optional<PositionChanges> Changes;
+        /// Количество строк версии, построенной по индексу
+        size_t RowsCount = 0;
 
+        size_t GetSize() const;
         QVariant GetId(int aI) const;
+        /// aI должен быть меньше GetSize()
+        qlonglong GetIdAt(size_t aI) const;
         bool IsOutOfRange(int aI) const;
 
         std::optional<size_t> GetRow(const QVariant& aId) const;
+        /// Позиция в этой версии строки aRow предыдущей версии aPrevious
+        std::optional<size_t> TransformFrom(const IdsInfo& aPrevious, size_t aRow) const;
+        void CopyIds(size_t aCount, QVector<qlonglong>& outIds) const;
 
         void AddId(const QVariant& aId);
     };
@@ -165,7 +229,8 @@ public:
         Qt::SortOrder aDefaultSortDirection,
         QObject* aParent,
         bool aIsFile,
-        const QPointer<TableOperationHandlerBase>& aHandler);
+        const QPointer<TableOperationHandlerBase>& aHandler,
+        bool aTrackRevisions = true);
 
     virtual ~SyncSqlCache() override;
 
@@ -173,6 +238,9 @@ public:
 
     const QString& GetTableName() const;
     void StopExport();
+    /// Прерывает выборки HeavyAction с id не больше aRequestId, если они выполняются или еще не начались.
+    /// Прерванная выборка не создает новой версии IdsInfo.
+    void InterruptSelection(qint64 aRequestId);
     
     ////////////////////////////////////////////////////////////////////////////////
     /// Синхронные методы для обмена информацией с пользовательскими плагинами /////
@@ -211,6 +279,16 @@ public slots:
     void ConfirmVersion(qint64 aVersion);
     void On_PerformSelect(QString aSql, QVariantList aParams);
     void On_SetAutoScroll(bool aIsAutoScroll);
+    /// Максимальное количество индексов для сортировок. 0 - индексы не создаются.
+    void On_SetSortIndexesBudget(int aMaxIndexesCount);
+    /// Включение полнотекстового индекса по колонкам общего поиска.
+    void On_SetFullTextIndex(bool aIsEnabled);
+    /// Включение индекса позиций строк в памяти (дерево порядковых статистик по ключу сортировки).
+    void On_SetOrderIndex(bool aIsEnabled);
+    /// Включение отдельного соединения для чтения (только для файлового хранилища).
+    /// Переводит файл в режим WAL; пользовательские запросы и экспорт выполняются
+    /// в потоке читателя и не ждут записи новых данных.
+    void On_SetReaderConnection(bool aIsEnabled);
     void OnExport(
         const QString& aExportFileName,
         const ColumnsExportInfo& aColumns);
@@ -238,16 +316,131 @@ signals:
 
 private:
 
+    /// Пересчитывает строки версии Versions.front() в строки Versions.back()
+    /// последовательно через все промежуточные версии
     struct RowTransformator
     {
-        const IdsInfo& Old;
-        const IdsInfo& New;
+        std::vector<const IdsInfo*> Versions;
 
         int Transform(int aRow) const;
         RowRange Transform(const RowRange& aRowRange) const;
     };
 
+    struct SortColumn
+    {
+        int Column;
+        Qt::SortOrder Order;
+    };
+    using TSortColumns = std::vector<SortColumn>;
+
+    struct SortIndex
+    {
+        QString Name;
+        /// Колонки индекса в формате "col1 ASC, col2 DESC"
+        QString Columns;
+        bool IsCreated = false;
+    };
+
+    /// Значения колонок сортировки строки в порядке GetSortColumns
+    struct SortKeyRow
+    {
+        qlonglong Id;
+        QVariantList Key;
+    };
+
+    /// Порядок строк выборки по ключу сортировки (ключ включает id)
+    struct SortKeyLess
+    {
+        const SyncSqlCache* Cache;
+        TSortColumns Columns;
+
+        bool operator()(const SortKeyRow& aLeft, const SortKeyRow& aRight) const;
+    };
+    using TSortKeyTree = OrderStatisticTree<SortKeyRow, SortKeyLess>;
+
+    /// Позиции строк выборки по ключу сортировки.
+    /// Ключи по id нужны для поиска позиции строки по id, QVariantList разделяет данные с узлами дерева.
+    struct SortKeyIndex
+    {
+        TSortKeyTree Tree;
+        std::unordered_map<qlonglong, QVariantList> Keys;
+
+        explicit SortKeyIndex(SortKeyLess aLess);
+
+        void Assign(std::vector<SortKeyRow>&& aSortedRows);
+        std::optional<size_t> GetRow(qlonglong aId) const;
+        const QVariantList* GetKey(qlonglong aId) const;
+        bool Insert(SortKeyRow aRow);
+        bool Erase(qlonglong aId);
+    };
+
+    /// Изменения основной таблицы, выполненные в текущем HeavyAction
+    struct BatchChanges
+    {
+        /// Id вставленных или замененных строк
+        std::unordered_set<qlonglong> ChangedIds;
+        /// Id удаленных строк
+        std::unordered_set<qlonglong> DeletedIds;
+        /// Ключи сортировки строк выборки до их первого изменения
+        std::unordered_map<qlonglong, QVariantList> OldKeys;
+        /// Значения строк до их первого изменения, известные из кэша строк окна
+        std::unordered_map<qlonglong, QVariantList> OldRows;
+        /// false, если таблица изменялась в обход отслеживаемых действий
+        bool IsComplete = true;
+    };
+
+    /// Результат HeavyAction, который отправляется после чтения всех id выборки
+    struct HeavyActionResult
+    {
+        qint64 RequestId = 0;
+        TSelectedIds SelectedRows;
+        std::optional<std::pair<qint64, qint64>> InsertionDuration;
+        std::optional<int> SelectionDuration;
+        bool MainTableUpdatedOrLoadFinished = false;
+        bool IsSuspend = false;
+        LoadingStatus Status = LoadingStatus::NotChanged;
+        size_t ValuesCount = 0;
+    };
+
+    /// HeavyAction, полученный в конвейере во время чтения выборки предыдущего
+    struct QueuedHeavyAction
+    {
+        qint64 RequestId = 0;
+        TNewItemsBufferPtr Values;
+        LoadingStatus Status = LoadingStatus::NotChanged;
+        TSortParametersArg Sorting;
+        TFilterParametersArg Filter;
+        bool ReportSelected = false;
+        bool SuspendUpdates = false;
+    };
+
+    /// Выборка, id которой читаются частями
+    struct PendingSelection
+    {
+        QSqlQuery Query;
+        QString Sql;
+        TSortColumns SortColumns;
+        bool IsSelected = true;
+        /// Вместе с id читаются ключи сортировки для mSortKeyIndex
+        bool HasSortKeys = false;
+        /// Ключи, прочитанные из SQLite, упорядочены по SortKeyLess
+        bool IsOrdered = true;
+        IdsInfo Ids;
+        std::vector<SortKeyRow> SortKeyRows;
+        qint64 StartTime = 0;
+        qint64 QueryDuration = 0;
+        /// Ошибка чтения строки выборки. Выборка с ошибкой не создает новой версии IdsInfo.
+        QString Error;
+        /// Отсутствует, если выборка выполняется не в HeavyAction
+        std::optional<HeavyActionResult> HeavyAction;
+    };
+
+    static constexpr int DefaultSortIndexesBudget = 3;
+    /// Индексы строятся, если таблица не используется в течение этого времени
+    static constexpr int SortIndexesIdleTimeoutMs = 2000;
+
     TCommonIndexesRanges mCommonFieldsIndexes;
+    const int mIdColumn;
 
     QString mFilter;
     int mSortColumn = -1;
@@ -255,11 +448,12 @@ private:
 
     RowRange mRequestedRowRange;
     RowRange mRequestedRowRangeVisible;
+    int mRequestedTopMargin = SqlQueryUtils::RowWindowOffset;
+    int mRequestedBottomMargin = SqlQueryUtils::RowWindowOffset;
     bool mIsAutoScroll = true;
     bool mIsSelectionAllowed = false;
 
-    /// Приблизительные оценки операций, выполненных с таблицами
-    size_t mTableOperationsCounter = 0;
+    /// Приблизительная оценка операций, выполненных с таблицей приостановленных записей
     size_t mSuspendedRecordsCounter = 0;
 
     std::map<qint64, IdsInfo> mVersionedIds;
@@ -277,9 +471,67 @@ private:
     SqlCacheTable mSuspendedItemsTable;
     QSet<qlonglong> mSuspendedDeletedIds;
 
+    BatchChanges mBatchChanges;
+    /// Текущая версия IdsInfo соответствует содержимому основной таблицы
+    /// с точностью до mBatchChanges, поэтому её можно обновить инкрементально.
+    bool mIsIdMappingActual = false;
+    /// Количество строк сверено после окончания текущей загрузки. Сбрасывается при очистке.
+    bool mIsDbRowCountVerified = false;
+
     TracerGuiWrapper mSqlCacheTracer;
 
-    std::atomic_bool mStopExport {false};
+    const std::shared_ptr<std::atomic_bool> mStopExport = std::make_shared<std::atomic_bool>(false);
+    QueryInterruption mSelectionInterruption;
+
+    /// Последняя выданная метка версии строки окна
+    qint64 mRowStampCounter = 0;
+    /// Сглаженное время загрузки строки окна, мкс. Передается в ViewWindowValues::RowFetchCostUs.
+    qint64 mRowFetchCostUs = 0;
+    /// Передается в ViewWindowValues::RowsRevision
+    qint64 mRowsRevision = 0;
+    /// Значения _rev строк текущего окна. Строки с прежним _rev после повторной выборки
+    /// не перечитываются. Очищается, если таблица изменялась без обновления _rev.
+    std::unordered_map<qlonglong, qlonglong> mViewWindowRevisions;
+
+    /// Строки основной таблицы, загруженные для окна, в порядке последнего использования.
+    /// Строка удаляется при изменении через InsertOrReplace и DeleteRecords,
+    /// весь кэш очищается при изменениях в обход этих методов.
+    using TRowCache = std::list<std::pair<qlonglong, QVariantList>>;
+    static constexpr size_t RowCacheSize = 4096;
+    TRowCache mRowCache;
+    std::unordered_map<qlonglong, TRowCache::iterator> mRowCachePositions;
+
+    /// Индексы для сортировок. В начале списка - последняя использованная сортировка.
+    std::list<SortIndex> mSortIndexes;
+    int mSortIndexesBudget = DefaultSortIndexesBudget;
+    int mSortIndexesCounter = 0;
+    QTimer mSortIndexesTimer { this };
+
+    bool mUseFullTextIndex = false;
+    /// Скрытые колонки *_folded поддерживаются триггером при UPDATE колонок общего поиска,
+    /// поэтому фильтр может использовать их вместо LOWER().
+    bool mUseFoldedColumns = false;
+
+    /// Длительность одной порции чтения id выборки
+    static constexpr int SelectionSliceMs = 5;
+    /// Время проверяется раз в столько строк
+    static constexpr size_t SelectionSliceCheckRows = 256;
+    std::optional<PendingSelection> mPendingSelection;
+    /// Выполняются по порядку после чтения mPendingSelection
+    std::deque<QueuedHeavyAction> mQueuedHeavyActions;
+
+    bool mUseOrderIndex = false;
+    /// Строки текущей версии IdsInfo в порядке выборки.
+    /// Строится при выборке, если включен mUseOrderIndex. Версии IdsInfo ссылаются на индекс,
+    /// поэтому новая выборка создает новый индекс, а не изменяет прежний.
+    std::shared_ptr<SortKeyIndex> mSortKeyIndex;
+
+    const bool mIsFile;
+    bool mUseReaderConnection = false;
+    /// Поток из DbThreadPool: собственный или, если включены общие потоки, общий с хранилищами моделей
+    QThread* mReaderThread = nullptr;
+    /// Создается в потоке хранилища, живет в mReaderThread
+    QPointer<SqlReaderConnection> mReader;
     
 private:
     /// Методы инициализации, вызываемые в конструкторе ////////////////////////////
@@ -289,6 +541,11 @@ private:
         const SqlQueryUtils::TSortOrder& aSortOrder,
         int aMaxColumn,
         int aIdColumn);
+    /// Имена скрытых колонок основной таблицы с приведенными к нижнему регистру
+    /// значениями колонок общего поиска.
+    static QStringList MakeFoldedFields(
+        const SqlFieldDescription* aFieldList,
+        const TCommonIndexesRanges& aCommonFieldsIndexes);
 
     ////////////////////////////////////////////////////////////////////////////////
     /// Обертки над SqlCacheTable //////////////////////////////////////////////////
@@ -297,7 +554,18 @@ private:
         const QString& aSql,
         const QVariantList& aParams) noexcept;
     QSqlRecord GetItem(const QVariant& aId);
+    /// Загружает строки по набору id минимальным количеством запросов.
+    /// Порядок строк не гарантируется, поэтому результат индексирован по id.
+    /// Если передан outRevisions, в него добавляются значения _rev загруженных строк.
+    std::unordered_map<qlonglong, QVariantList> GetItemsValues(
+        const std::vector<qlonglong>& aIds,
+        std::unordered_map<qlonglong, qlonglong>* outRevisions = nullptr);
+    /// Значения _rev строк основной таблицы
+    std::unordered_map<qlonglong, qlonglong> GetItemsRevisions(const std::vector<qlonglong>& aIds) noexcept(false);
     qlonglong GetDbRowCount();
+    /// Сверяет отслеживаемое количество строк основной таблицы с полным подсчётом
+    /// и заменяет его результатом подсчёта. Выполняется один раз за загрузку.
+    void VerifyDbRowCount();
     qlonglong GetSuspendDbRowCount();
 
     ////////////////////////////////////////////////////////////////////////////////
@@ -305,6 +573,7 @@ private:
 
     int GetRecordsCount() const;
     const IdsInfo* GetIdMapping() const;
+    const IdsInfo* GetCurrentIdMapping() const;
     std::optional<RowTransformator> GetRowTransformation(qint64 aVersion) const;
 
     ////////////////////////////////////////////////////////////////////////////////
@@ -316,8 +585,7 @@ private:
     /// Методы для обработки HeavyAction ///////////////////////////////////////////
 
     void SetUpdatesFromDbAllowed(LoadingStatus aLoadingStatus);
-    /// В зависимости от режима хранилища возвращает точное или приблизительное
-    /// количество записей в основной таблице
+    /// Возвращает точное количество записей в основной таблице
     std::pair<std::optional<int>, std::optional<int>> EstimateDbRowCount(
         bool aMainTableUpdated,
         bool aIsSuspend);
@@ -326,7 +594,24 @@ private:
         bool aMainTableUpdated,
         const TSortParametersArg aSorting,
         const TFilterParametersArg aFilter);
-    void PerformSelection();
+    /// Выполняет запрос выборки и читает первую порцию id.
+    /// Если id прочитаны не все, оставляет mPendingSelection и продолжает чтение через очередь событий.
+    /// Возвращает false, если выборка прервана через InterruptSelection.
+    bool PerformSelection();
+    /// Читает id выборки в течение SelectionSliceMs. Возвращает true, если прочитаны все id.
+    bool ReadSelectionSlice();
+    void ScheduleSelectionSlice();
+    void ContinueSelection();
+    /// Завершает прочитанную выборку и отвечает на HeavyAction, которому она принадлежит.
+    void CompletePendingSelection();
+    /// Создает версию IdsInfo из mPendingSelection. Возвращает false, если выборка прервана.
+    bool FinishSelection();
+    void CompleteHeavyAction(const HeavyActionResult& aResult);
+    /// Выполняет HeavyAction, отложенные до окончания чтения выборки.
+    void ProcessQueuedHeavyActions();
+    /// Устанавливает или снимает обработчик прерывания выборки на соединении хранилища.
+    bool SetSelectionInterruptible(bool aIsInterruptible);
+    bool IsSelectionInterrupted() const;
     void LogHeavyAction(
         std::optional<std::pair<qint64, qint64>> insertionDuration,
         std::optional<int> selectionDuration,
@@ -334,9 +619,37 @@ private:
         std::optional<int> rowCountingDuration,
         size_t aValuesSize);
 
-    void ProcessDataPopulation(QSqlQuery& aQuery);
+    /// Создает новую версию IdsInfo и обновляет выделение и окно.
+    /// Если aRefreshAll не выставлен, строки окна перечитываются только для id из aRefreshedIds.
+    void ProcessDataPopulation(
+        IdsInfo&& aIds,
+        bool aRefreshAll,
+        const std::unordered_set<qlonglong>& aRefreshedIds = {});
     void UpdateRowWindow();
-    void UpdateIdMapping(QSqlQuery& aQuery);
+    void UpdateIdMapping(IdsInfo&& aIds);
+
+    /// Применяет mBatchChanges к текущей версии IdsInfo без повторной выборки.
+    /// Возвращает false, если изменения нельзя применить инкрементально.
+    bool TryApplyBatchChanges();
+    /// Применяет mBatchChanges через mSortKeyIndex: строки могут вставляться и смещаться в любую позицию.
+    /// aChangedRows - ключи измененных строк, удовлетворяющих фильтру.
+    bool TryApplyBatchChangesToSortKeyIndex(
+        const IdsInfo& aIds,
+        const TSortColumns& aSortColumns,
+        std::vector<SortKeyRow>&& aChangedRows);
+    /// Перечитывает строки окна без создания новой версии IdsInfo.
+    void RefreshViewWindowRows(const std::unordered_set<qlonglong>& aRefreshedIds);
+    /// Значения колонок сортировки для набора id.
+    /// Если aIsFiltered выставлен, возвращаются только строки, удовлетворяющие фильтру.
+    std::vector<SortKeyRow> GetSortKeys(
+        const std::vector<qlonglong>& aIds,
+        const TSortColumns& aSortColumns,
+        bool aIsFiltered) noexcept(false);
+    /// Сравнение ключей сортировки в порядке ORDER BY
+    int CompareSortKeys(
+        const QVariantList& aLeft,
+        const QVariantList& aRight,
+        const TSortColumns& aSortColumns) const;
 
     void SetSorting(const TSortParametersArg& aSorting);
     void SetFilter(const TFilterParametersArg& aFilter);
@@ -354,18 +667,37 @@ private:
     void StoreItemsToDb(
         const TNewItemsBufferPtr& aValues,
         bool aSuspend) noexcept(false);
+    /// Вставляет подготовленные строки многострочными запросами.
     void InsertOrReplace(
-        const QVariantList& aFields,
+        const QVariantList& aRows,
         bool aSuspend) noexcept(false);
     bool AddPendingValue(QVariantList& aValues);
-    void DeleteRecord(qlonglong aId, bool aSuspend) noexcept(false);
+    /// Запоминает ключи сортировки строк выборки перед их заменой,
+    /// чтобы проверить, сместятся ли строки.
+    void RememberOldSortKeys(const QVariantList& aRows) noexcept(false);
+    /// Удаляет строки запросами вида DELETE ... WHERE id IN (...).
+    void DeleteRecords(const QVariantList& aIds, bool aSuspend) noexcept(false);
     void ResumeSuspendedItems() noexcept(false);
     
     ////////////////////////////////////////////////////////////////////////////////
     /// Методы обновления ViewWindowValues /////////////////////////////////////////
 
-    void UpdateViewWindowValues(bool aRefreshAll);
-    void UpdateViewWindowValuesInternal(bool aRefreshAll);
+    /// Строки текущего окна переиспользуются по id, кроме строк из aRefreshedIds.
+    void UpdateViewWindowValues(
+        bool aRefreshAll,
+        const std::unordered_set<qlonglong>& aRefreshedIds = {});
+    void UpdateViewWindowValuesInternal(
+        bool aRefreshAll,
+        const std::unordered_set<qlonglong>& aRefreshedIds);
+    /// Строка из кэша строк окна или nullptr. Найденная строка становится последней использованной.
+    const QVariantList* GetCachedRow(qlonglong aId);
+    void CacheRow(qlonglong aId, const QVariantList& aRow);
+    void EraseCachedRow(qlonglong aId);
+    /// Убирает измененную строку из кэша, сохраняя прежние значения в mBatchChanges.OldRows
+    void EvictChangedRow(qlonglong aId);
+    /// Строка окна без значений: удерживает позицию строки, значения которой недоступны
+    QVariantList MakePlaceholderRow(qlonglong aId) const;
+    void ClearRowCache();
     void UpdateExtraData();
     
     ////////////////////////////////////////////////////////////////////////////////
@@ -378,6 +710,8 @@ private:
     SelectionRequest TransformSelection(const SelectionRequest& aSelectionRequest); 
     static bool TransformRowRange(
         const RowTransformator& aTransformator,
+        int aTopMargin,
+        int aBottomMargin,
         RowRange& outRange,
         RowRange& outRangeVisible);
     std::optional<RowRequest> TransformRowRange(const RowRequest& aRowRequest);
@@ -387,10 +721,44 @@ private:
 
     /// Логирование и отправка сигнала об ошибке
     void ReportError(const QString& aContext);
+    /// Колонки сортировки с учетом сортировки по умолчанию.
+    /// Последней всегда идет колонка id, чтобы порядок строк был однозначным.
+    TSortColumns GetSortColumns() const;
     /// Формирование ORDER BY строки для sql запроса
     QString OrderByClause() const;
+
+    ////////////////////////////////////////////////////////////////////////////////
+    /// Методы управления индексами для сортировок
+
+    /// Колонки индекса, по которому можно выполнить сортировку без временного B-дерева.
+    /// Направления приводятся к виду, в котором первая колонка сортируется по возрастанию,
+    /// т.к. SQLite умеет обходить индекс в обратном порядке.
+    QString GetSortIndexColumns(const TSortColumns& aSortColumns) const;
+    /// Отмечает текущую сортировку как последнюю использованную.
+    void TouchSortIndex();
+    /// Откладывает построение индексов до простоя таблицы.
+    void ScheduleSortIndexesMaintenance();
+    /// Удаляет индексы сверх бюджета и строит один недостающий.
+    void MaintainSortIndexes();
+
+    ////////////////////////////////////////////////////////////////////////////////
+    /// Методы работы с полнотекстовым индексом
+
+    /// Создаёт или удаляет индекс. При ошибке индекс отключается.
+    void SetFullTextIndex(bool aIsEnabled);
+    /// Фильтр для выборки с отбором кандидатов по полнотекстовому индексу
+    QString GetSelectionFilter() const;
+    /// Имена колонок общего поиска в порядке mCommonFieldsIndexes
+    QStringList GetCommonColumns() const;
     SqlCacheTable& GetTable(bool aSuspend);
     static QVariantList Record2List(const QSqlRecord& aRecord);
+
+    ////////////////////////////////////////////////////////////////////////////////
+    /// Методы управления соединением для чтения
+
+    /// Переводит файл хранилища в режим WAL и запускает SqlReaderConnection.
+    void StartReaderConnection();
+    void StopReaderConnection();
 };
 
 Q_DECLARE_METATYPE(RowRange)
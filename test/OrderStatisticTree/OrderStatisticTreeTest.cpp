@@ -0,0 +1,3 @@
+#include "OrderStatisticTreeTest.h"
+
+QTEST_MAIN(OrderStatisticTreeTest)
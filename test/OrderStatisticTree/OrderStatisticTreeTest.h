@@ -0,0 +1,175 @@
+#pragma once
+
+#include "TableModels/OrderStatisticTree.h"
+
+#include <QTest>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+class OrderStatisticTreeTest : public QObject
+{
+Q_OBJECT
+
+private:
+    using TTree = OrderStatisticTree<int, std::less<int>>;
+
+    /// Сравнивает дерево с упорядоченным вектором: размер, обход, At и Rank
+    static void Compare(const TTree& aTree, const std::vector<int>& aExpected)
+    {
+        QCOMPARE(aTree.Size(), aExpected.size());
+
+        std::vector<int> values;
+        aTree.ForEach([&values](int aValue) { values.push_back(aValue); });
+        QVERIFY(values == aExpected);
+
+        for (size_t i = 0; i < aExpected.size(); ++i)
+        {
+            QCOMPARE(aTree.At(i), aExpected[i]);
+            const auto rank = aTree.Rank(aExpected[i]);
+            QVERIFY(rank.has_value());
+            QCOMPARE(*rank, i);
+        }
+    }
+
+    static std::vector<int> MakeSorted(int aCount, int aStep)
+    {
+        std::vector<int> values;
+        for (int i = 0; i < aCount; ++i)
+        {
+            values.push_back(i * aStep);
+        }
+        return values;
+    }
+
+private slots:
+    void TestEmpty()
+    {
+        TTree tree { std::less<int> {} };
+        Compare(tree, {});
+        QVERIFY(!tree.Rank(1).has_value());
+        QVERIFY(!tree.Erase(1));
+
+        tree.Assign({});
+        Compare(tree, {});
+    }
+
+    void TestAssign()
+    {
+        for (const auto count : { 1, 2, 3, 100, 1000 })
+        {
+            auto expected = MakeSorted(count, 2);
+            TTree tree { std::less<int> {} };
+            tree.Assign(std::vector<int> { expected });
+            Compare(tree, expected);
+
+            /// Значения, которых нет в дереве
+            QVERIFY(!tree.Rank(-1).has_value());
+            QVERIFY(!tree.Rank(1).has_value());
+            QVERIFY(!tree.Rank(count * 2).has_value());
+        }
+    }
+
+    void TestAssignReplacesValues()
+    {
+        TTree tree { std::less<int> {} };
+        tree.Assign(MakeSorted(100, 1));
+        tree.Assign({ 5, 7 });
+        Compare(tree, { 5, 7 });
+    }
+
+    void TestInsert()
+    {
+        TTree tree { std::less<int> {} };
+        std::vector<int> expected;
+
+        std::mt19937 random { 1 };
+        for (int i = 0; i < 500; ++i)
+        {
+            const auto value = static_cast<int>(random() % 1000);
+            const auto it = std::lower_bound(expected.begin(), expected.end(), value);
+            const bool isNew = it == expected.end() || *it != value;
+            if (isNew)
+            {
+                expected.insert(it, value);
+            }
+            QCOMPARE(tree.Insert(value), isNew);
+        }
+        Compare(tree, expected);
+    }
+
+    void TestErase()
+    {
+        auto expected = MakeSorted(300, 1);
+        TTree tree { std::less<int> {} };
+        tree.Assign(std::vector<int> { expected });
+
+        std::mt19937 random { 2 };
+        while (!expected.empty())
+        {
+            const auto index = random() % expected.size();
+            const auto value = expected[index];
+            expected.erase(expected.begin() + static_cast<std::ptrdiff_t>(index));
+            QVERIFY(tree.Erase(value));
+            QVERIFY(!tree.Erase(value));
+            QVERIFY(!tree.Rank(value).has_value());
+            if (expected.size() % 50 == 0)
+            {
+                Compare(tree, expected);
+            }
+        }
+        Compare(tree, {});
+    }
+
+    void TestMixedOperations()
+    {
+        auto expected = MakeSorted(200, 3);
+        TTree tree { std::less<int> {} };
+        tree.Assign(std::vector<int> { expected });
+
+        std::mt19937 random { 3 };
+        for (int i = 0; i < 2000; ++i)
+        {
+            const auto value = static_cast<int>(random() % 1000);
+            const auto it = std::lower_bound(expected.begin(), expected.end(), value);
+            const bool isPresent = it != expected.end() && *it == value;
+            if (random() % 2 == 0)
+            {
+                QCOMPARE(tree.Insert(value), !isPresent);
+                if (!isPresent)
+                {
+                    expected.insert(it, value);
+                }
+            }
+            else
+            {
+                QCOMPARE(tree.Erase(value), isPresent);
+                if (isPresent)
+                {
+                    expected.erase(it);
+                }
+            }
+
+            if (i % 200 == 0)
+            {
+                Compare(tree, expected);
+            }
+        }
+        Compare(tree, expected);
+    }
+
+    void TestCustomLess()
+    {
+        /// Обратный порядок
+        OrderStatisticTree<int, std::greater<int>> tree { std::greater<int> {} };
+        tree.Assign({ 9, 5, 1 });
+        QVERIFY(tree.Insert(7));
+        QVERIFY(tree.Erase(1));
+        QCOMPARE(tree.Size(), size_t { 3 });
+        QCOMPARE(tree.At(0), 9);
+        QCOMPARE(tree.At(1), 7);
+        QCOMPARE(tree.At(2), 5);
+        QCOMPARE(*tree.Rank(7), size_t { 1 });
+    }
+};
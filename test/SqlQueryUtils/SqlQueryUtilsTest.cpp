@@ -0,0 +1,3 @@
+#include "SqlQueryUtilsTest.h"
+
+QTEST_MAIN(SqlQueryUtilsTest)
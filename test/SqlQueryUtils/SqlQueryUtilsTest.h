@@ -0,0 +1,100 @@
+#pragma once
+
+#include "TableModels/SqlQueryUtils.h"
+
+#include <QTest>
+
+class SqlQueryUtilsTest : public QObject
+{
+Q_OBJECT
+
+private:
+    static QString FullTextFilter(const QString& aFilter)
+    {
+        return SqlQueryUtils::GetFullTextIndexFilter(aFilter, "trades_fts", { "common" });
+    }
+
+private slots:
+    void TestFoldedColumnFilter()
+    {
+        QCOMPARE(
+            SqlQueryUtils::GetFoldedColumnFilter(
+                "LOWER(common) GLOB '*abc*' AND lower( common ) REGEXP 'x' AND LOWER(other) = 'y' AND LOWER(commonx) = 'z'",
+                { "common" }),
+            QString("common_folded GLOB '*abc*' AND common_folded REGEXP 'x' AND LOWER(other) = 'y' AND LOWER(commonx) = 'z'"));
+        QCOMPARE(SqlQueryUtils::GetFoldedColumnFilter("LOWER(common) = 'x'", {}), QString("LOWER(common) = 'x'"));
+    }
+
+    void TestFullTextFilterFoldedColumn()
+    {
+        QCOMPARE(
+            FullTextFilter("common_folded GLOB '*abc*'"),
+            QString("(id IN (SELECT rowid FROM trades_fts WHERE common MATCH '\"abc\"') AND common_folded GLOB '*abc*')"));
+    }
+
+    void TestFullTextFilterLowerColumn()
+    {
+        QCOMPARE(
+            FullTextFilter("LOWER(common) GLOB '*abc*'"),
+            QString("(id IN (SELECT rowid FROM trades_fts WHERE common MATCH '\"abc\"') AND LOWER(common) GLOB '*abc*')"));
+    }
+
+    void TestFullTextFilterCaseSensitiveColumn()
+    {
+        QCOMPARE(
+            FullTextFilter("common GLOB '*AbC*'"),
+            QString("(id IN (SELECT rowid FROM trades_fts WHERE common MATCH '\"AbC\"') AND common GLOB '*AbC*')"));
+    }
+
+    void TestFullTextFilterGlobMetacharacters()
+    {
+        /// Шаблоны со спецсимволами GLOB, в том числе экранированными через [], не переписываются
+        const QStringList filters {
+            "common_folded GLOB '*ab*cd*'",
+            "common_folded GLOB '*ab?cd*'",
+            "common_folded GLOB '*ab[*]cd*'",
+            "common_folded GLOB '*ab[?]cd*'",
+            "common_folded GLOB '*ab[[]cd*'",
+        };
+        for (const auto& filter : filters)
+        {
+            QCOMPARE(FullTextFilter(filter), filter);
+        }
+    }
+
+    void TestFullTextFilterShortSubstring()
+    {
+        const QString filter = "common_folded GLOB '*ab*'";
+        QCOMPARE(FullTextFilter(filter), filter);
+    }
+
+    void TestFullTextFilterQuotes()
+    {
+        QCOMPARE(
+            FullTextFilter("common_folded GLOB '*a\"bc*'"),
+            QString("(id IN (SELECT rowid FROM trades_fts WHERE common MATCH '\"a\"\"bc\"') AND common_folded GLOB '*a\"bc*')"));
+    }
+
+    void TestFullTextFilterMultipleTerms()
+    {
+        QCOMPARE(
+            FullTextFilter("(common_folded GLOB '*abc*' AND side = 1) OR common_folded GLOB '*xy*' OR common_folded GLOB '*def*'"),
+            QString(
+                "((id IN (SELECT rowid FROM trades_fts WHERE common MATCH '\"abc\"') AND common_folded GLOB '*abc*') AND side = 1)"
+                " OR common_folded GLOB '*xy*'"
+                " OR (id IN (SELECT rowid FROM trades_fts WHERE common MATCH '\"def\"') AND common_folded GLOB '*def*')"));
+    }
+
+    void TestFullTextFilterOtherColumnsAndRegexp()
+    {
+        const QStringList filters {
+            "other_folded GLOB '*abc*'",
+            "commonx GLOB '*abc*'",
+            "common_folded REGEXP 'abc'",
+        };
+        for (const auto& filter : filters)
+        {
+            QCOMPARE(FullTextFilter(filter), filter);
+        }
+    }
+};
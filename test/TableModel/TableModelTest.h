@@ -20,5 +20,33 @@ private slots:
         table.clear();
         QVERIFY(table.rowCount(QModelIndex()) == 0);
     }
+
+    void TestScrollDuringSelectionAfterRemove()
+    {
+        TestTableModel table;
+        table.Add10();
+        QVERIFY(table.rowCount(QModelIndex()) == 10);
+        table.SetRowWindow(0, 9);
+
+        /// Окно, построенное по предыдущей версии во время выборки после удаления,
+        /// не обрезается на удаленной строке
+        bool isWindowComplete = true;
+        QObject::connect(&table, &AsyncSqlTableModelBase::ViewWindowValuesChanged, [&table, &isWindowComplete]()
+        {
+            const auto& values = table.GetViewData();
+            if (values.RowsVisible.IsValid())
+            {
+                isWindowComplete &= values.RowsVisible.Bottom == (std::min)(9, values.RecordsCount - 1);
+            }
+        });
+
+        table.TestClearStaleRecords();
+        table.SetRowWindow(1, 9);
+        table.SetRowWindow(0, 9);
+
+        QTRY_COMPARE(table.rowCount(QModelIndex()), 2);
+        QTRY_COMPARE(table.GetViewData().Data.size(), 2);
+        QVERIFY(isWindowComplete);
+    }
 };
 